@@ -0,0 +1,614 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "CpuFeatures.h"
+#include "DirectSummation.h"
+#include "ForceKernels.h"
+#include "Globals.h"
+#include "Integrator.h"
+#include "Morton.h"
+#include "ParticleGenerator.h"
+#include "RadixSort.h"
+#include "Simulation.h"
+
+// Micro benchmarks for single pipeline stages: barnes-hut-bench <benchmark> [bodies] [repetitions] [threads]
+
+// best of `repetitions`, setup() runs outside the timed region
+static double timeBest(int repetitions, const std::function<void()>& setup, const std::function<void()>& body) {
+    double best = 1e30;
+    for (int r = 0; r < repetitions; r++) {
+        setup();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+    }
+    return best;
+}
+
+static ParticleStore createBodies(int count) {
+    ParticleStore particles;
+    ParticleGenerator::createDisc(particles, 0, 0, 0, count, genParticleMass, genCenterMass, minRadius, maxRadius, 0, 0, 0);
+
+    ThreadPool pool(1);
+    auto bounds = findMinMax(particles, pool, 1);
+    computeMortonCodes(particles, bounds, pool, 1);
+    return particles;
+}
+
+static bool sameOrder(const ParticleStore& a, const ParticleStore& b) {
+    return a.key == b.key;
+}
+
+// direct summation (in double) on every stride-th body, the reference for force errors
+static std::vector<std::array<double, 3>> directSample(const ParticleStore& particles, size_t stride) {
+    std::vector<std::array<double, 3>> exact;
+    for (size_t i = 0; i < particles.size(); i += stride) {
+        std::array<double, 3> a = {0, 0, 0};
+        for (size_t j = 0; j < particles.size(); j++) {
+            if (j == i) continue;
+            double dx = particles.x[j] - particles.x[i], dy = particles.y[j] - particles.y[i], dz = particles.z[j] - particles.z[i];
+            double distSq = dx*dx + dy*dy + dz*dz + EPSILON_SQ;
+            double factor = G * G_MULTIPLIER * particles.mass[j] / (distSq * std::sqrt(distSq));
+            a[0] += dx * factor; a[1] += dy * factor; a[2] += dz * factor;
+        }
+        exact.push_back(a);
+    }
+    return exact;
+}
+
+// relative to the mean exact force, single bodies can have an almost cancelling net force
+static double rmsError(const ParticleStore& particles, const std::vector<std::array<double, 3>>& exact, size_t stride) {
+    double errorSq = 0.0, normSq = 0.0;
+    for (size_t s = 0; s < exact.size(); s++) {
+        size_t i = s * stride;
+        errorSq += std::pow(particles.ax[i] - exact[s][0], 2) + std::pow(particles.ay[i] - exact[s][1], 2) + std::pow(particles.az[i] - exact[s][2], 2);
+        normSq += exact[s][0] * exact[s][0] + exact[s][1] * exact[s][1] + exact[s][2] * exact[s][2];
+    }
+    return std::sqrt(errorSq / normSq);
+}
+
+static void benchSort(int count, int repetitions) {
+    ThreadPool pool(NUM_THREADS);
+    RadixSort radixSort;
+
+    const ParticleStore source = createBodies(count);
+    ParticleStore radixSorted;
+
+    // baseline: the array of Particle structs sorted with std::sort, as before the structure of arrays storage
+    std::vector<Particle> structs, stdSorted;
+    for (size_t i = 0; i < source.size(); i++) structs.push_back(source.get(i));
+
+    double stdTime = timeBest(repetitions, [&] { stdSorted = structs; }, [&] {
+        std::sort(stdSorted.begin(), stdSorted.end(), comp);
+    });
+    double radixTime = timeBest(repetitions, [&] { radixSorted = source; }, [&] {
+        radixSort.sort(radixSorted, pool, NUM_THREADS);
+    });
+
+    std::cout << "sort " << count << " bodies, " << NUM_THREADS << " threads\n";
+    std::cout << "std::sort:  " << stdTime << " ms\n";
+    std::cout << "radix sort: " << radixTime << " ms (" << stdTime / radixTime << "x)\n";
+    bool same = true;
+    for (size_t i = 0; i < stdSorted.size(); i++) same = same && stdSorted[i].Z_CODE == radixSorted.key[i];
+    std::cout << "same order: " << (same ? "yes" : "NO") << "\n";
+}
+
+static void benchResort(int count, int repetitions) {
+    // a few real steps so the array carries the previous Morton order, like in the running simulation
+    Simulation simulation;
+    simulation.particles = createBodies(count);
+    for (int i = 0; i < 3; i++) simulation.step();
+
+    ParticleStore source = simulation.particles;
+    source.leapFrogPosStep(TIME_STEP);
+
+    ThreadPool pool(NUM_THREADS);
+    auto bounds = findMinMax(source, pool, NUM_THREADS);
+    computeMortonCodes(source, bounds, pool, NUM_THREADS);
+
+    RadixSort radixSort;
+    ParticleStore radixSorted, adaptiveSorted;
+
+    double radixTime = timeBest(repetitions, [&] { radixSorted = source; }, [&] {
+        radixSort.sort(radixSorted, pool, NUM_THREADS);
+    });
+    double adaptiveTime = timeBest(repetitions, [&] { adaptiveSorted = source; }, [&] {
+        radixSort.sort(adaptiveSorted, pool, NUM_THREADS, 1.0f);
+    });
+
+    std::cout << "re-sort " << count << " bodies after one step, " << NUM_THREADS << " threads\n";
+    std::cout << "unsorted keys: " << radixSort.unsortedFraction * 100.0f << "%\n";
+    std::cout << "radix sort:    " << radixTime << " ms\n";
+    std::cout << "adaptive sort: " << adaptiveTime << " ms (" << radixTime / adaptiveTime << "x)\n";
+    std::cout << "same order: " << (sameOrder(radixSorted, adaptiveSorted) ? "yes" : "NO") << "\n";
+}
+
+// the original encoder: one bit per axis per iteration
+static uint64_t mortonLoop(float x, float y, float z, const Bounds& bounds) {
+    uint64_t xs = scale(x, bounds[0].first, bounds[0].second);
+    uint64_t ys = scale(y, bounds[1].first, bounds[1].second);
+    uint64_t zs = scale(z, bounds[2].first, bounds[2].second);
+
+    uint64_t morton = 0;
+    for (int i = 0; i < 21; i++) {
+        morton |= ((xs >> i) & 1ull) << (3 * i);
+        morton |= ((ys >> i) & 1ull) << (3 * i + 1);
+        morton |= ((zs >> i) & 1ull) << (3 * i + 2);
+    }
+    return morton;
+}
+
+static void benchMorton(int count, int repetitions) {
+    ThreadPool pool(NUM_THREADS);
+    ParticleStore particles = createBodies(count);
+    std::vector<uint64_t> reference(count), magic(count);
+    Bounds bounds;
+
+    double boundsTime = timeBest(repetitions, [] {}, [&] {
+        bounds = findMinMax(particles, pool, NUM_THREADS);
+    });
+    double loopTime = timeBest(repetitions, [] {}, [&] {
+        for (int i = 0; i < count; i++) {
+            reference[i] = mortonLoop(particles.x[i], particles.y[i], particles.z[i], bounds);
+        }
+    });
+    double magicTime = timeBest(repetitions, [] {}, [&] {
+        for (int i = 0; i < count; i++) {
+            magic[i] = getMortonCodeFrom3D(particles.x[i], particles.y[i], particles.z[i], bounds);
+        }
+    });
+    double batchTime = timeBest(repetitions, [] {}, [&] {
+        computeMortonCodes(particles, bounds, pool, NUM_THREADS);
+    });
+
+    // the batch path scales with a precomputed 1 / extent, so allow the last bit of each axis to differ
+    size_t mismatches = 0, roundTripErrors = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t x0, y0, z0, x1, y1, z1;
+        decodeMorton(reference[i], x0, y0, z0);
+        decodeMorton(particles.key[i], x1, y1, z1);
+        if (std::abs((int64_t)x0 - x1) > 1 || std::abs((int64_t)y0 - y1) > 1 || std::abs((int64_t)z0 - z1) > 1) mismatches++;
+        if (magic[i] != reference[i] || encodeMorton(x0, y0, z0) != reference[i]) roundTripErrors++;
+        if (hasBMI2()) {
+            decodeMortonBMI2(reference[i], x1, y1, z1);
+            if (x0 != x1 || y0 != y1 || z0 != z1 || encodeMortonBMI2(x0, y0, z0) != reference[i]) roundTripErrors++;
+        }
+    }
+
+    std::cout << "morton codes for " << count << " bodies, " << NUM_THREADS << " threads, BMI2: " << (hasBMI2() ? "yes" : "no") << "\n";
+    std::cout << "bounds:             " << boundsTime << " ms\n";
+    std::cout << "21 step bit loop:   " << loopTime << " ms\n";
+    std::cout << "magic numbers:      " << magicTime << " ms\n";
+    std::cout << "batched + parallel: " << batchTime << " ms (" << loopTime / batchTime << "x)\n";
+    std::cout << "mismatches: " << mismatches << ", encode/decode errors: " << roundTripErrors << "\n";
+}
+
+static void benchKernels(int count, int repetitions) {
+    ParticleStore particles = createBodies(count);
+    const int targets = std::min(count, 2048);
+
+    std::vector<LeafKernel> kernels = {leafInteractionsScalar};
+    if (hasAVX2()) kernels.push_back(leafInteractionsAVX2);
+    if (hasAVX512()) kernels.push_back(leafInteractionsAVX512);
+
+    std::cout << "leaf kernels over " << count << " bodies, " << targets << " targets per leaf\n";
+
+    for (int leafSize : {8, 64, 512, 8192}) {
+        if (leafSize > count) break;
+        const int leaves = count / leafSize;
+
+        // scalar results are the reference for the error
+        std::vector<std::array<float, 3>> reference(targets);
+
+        for (LeafKernel kernel : kernels) {
+            std::vector<std::array<float, 3>> result(targets);
+
+            double time = timeBest(repetitions, [] {}, [&] {
+                for (int t = 0; t < targets; t++) {
+                    int start = (t % leaves) * leafSize;
+                    float ax = 0, ay = 0, az = 0;
+                    kernel(particles.x.data(), particles.y.data(), particles.z.data(), particles.mass.data(), start, start + leafSize, t, particles.x[t], particles.y[t], particles.z[t], EPSILON_SQ, ax, ay, az);
+                    result[t] = {ax, ay, az};
+                }
+            });
+            if (kernel == leafInteractionsScalar) reference = result;
+
+            double maxError = 0.0;
+            for (int t = 0; t < targets; t++) {
+                double ref = std::sqrt(reference[t][0] * reference[t][0] + reference[t][1] * reference[t][1] + reference[t][2] * reference[t][2]);
+                double diff = std::sqrt(std::pow(result[t][0] - reference[t][0], 2) + std::pow(result[t][1] - reference[t][1], 2) + std::pow(result[t][2] - reference[t][2], 2));
+                if (ref > 0) maxError = std::max(maxError, diff / ref);
+            }
+
+            std::cout << "leaf " << leafSize << ", " << leafKernelName(kernel) << ": "
+                      << time * 1e6 / ((double)targets * leafSize) << " ns/pair, max rel. error " << maxError << "\n";
+        }
+    }
+}
+
+// tree construction: serial depth first build vs parallel subtrees, the leaves must come out the same
+static void benchBuild(int count, int repetitions) {
+    ThreadPool pool(NUM_THREADS);
+    RadixSort radixSort;
+    Octree serial, parallel;
+
+    ParticleStore particles = createBodies(count);
+    radixSort.sort(particles, pool, NUM_THREADS);
+
+    double serialTime = timeBest(repetitions, [] {}, [&] { serial.buildTree(particles); });
+    std::cout << "tree build over " << count << " bodies, " << serial.nodeCount << " nodes\n";
+    std::cout << "serial: " << serialTime << " ms\n";
+
+    // the storage of the first builds is reused, a rebuild over the same bodies must not allocate
+    int64_t allocations = heapAllocationCount();
+    serial.buildTree(particles);
+    std::cout << "heap allocations per rebuild: " << heapAllocationCount() - allocations;
+    parallel.buildTree(particles, pool, NUM_THREADS);
+    allocations = heapAllocationCount();
+    parallel.buildTree(particles, pool, NUM_THREADS);
+    std::cout << " serial, " << heapAllocationCount() - allocations << " with " << NUM_THREADS << " threads\n";
+
+    for (int threads = 2; threads <= NUM_THREADS; threads *= 2) {
+        double time = timeBest(repetitions, [] {}, [&] { parallel.buildTree(particles, pool, threads); });
+
+        bool same = serial.nodeCount == parallel.nodeCount && serial.getLeaves().size() == parallel.getLeaves().size();
+        for (size_t l = 0; same && l < serial.getLeaves().size(); l++) {
+            const Node& a = serial.getNode(serial.getLeaves()[l]);
+            const Node& b = parallel.getNode(parallel.getLeaves()[l]);
+            same = a.start == b.start && a.end == b.end && a.size == b.size;
+        }
+
+        std::cout << threads << " threads: " << time << " ms (" << serialTime / time << "x)" << (same ? "" : ", TREES DIFFER") << "\n";
+    }
+
+    // mass pass over the parallel built tree, serial vs subtree parallel
+    parallel.buildTree(particles, pool, NUM_THREADS);
+    double serialMass = timeBest(repetitions, [] {}, [&] { parallel.computeMassDistribution(particles); });
+    const Node reference = parallel.getNode(0);
+    std::cout << "mass pass, serial: " << serialMass << " ms\n";
+
+    for (int threads = 2; threads <= NUM_THREADS; threads *= 2) {
+        double time = timeBest(repetitions, [] {}, [&] { parallel.computeMassDistribution(particles, pool, threads); });
+        const Node& root = parallel.getNode(0);
+        bool same = std::abs(root.mass - reference.mass) <= 1e-5f * reference.mass && std::abs(root.mcx - reference.mcx) <= 1e-3f * std::abs(reference.mcx) + 1e-3f;
+        std::cout << "mass pass, " << threads << " threads: " << time << " ms (" << serialMass / time << "x)" << (same ? "" : ", ROOT DIFFERS") << "\n";
+    }
+}
+
+// whole force pass over a built tree: recursive vs skip pointer walk, per particle and per leaf
+static void benchWalk(int count, int repetitions) {
+    ThreadPool pool(NUM_THREADS);
+    RadixSort radixSort;
+    Octree octree;
+
+    ParticleStore particles = createBodies(count);
+    radixSort.sort(particles, pool, NUM_THREADS);
+    octree.buildTree(particles, pool, NUM_THREADS);
+    octree.computeMassDistribution(particles, pool, NUM_THREADS);
+
+    const size_t n = particles.size();
+    std::vector<InteractionList> lists(NUM_THREADS);
+
+    const size_t stride = std::max<size_t>(1, n / 512);
+    const std::vector<std::array<double, 3>> exact = directSample(particles, stride);
+
+    auto forcePass = [&](int mode) {
+        pool.run(NUM_THREADS, [&](int thread, int threads) {
+            if (mode == FORCE_GROUP_WALK) {
+                const std::vector<int>& leaves = octree.getLeaves();
+                for (size_t l = thread; l < leaves.size(); l += threads) octree.computeForcesOnLeaf(leaves[l], particles, lists[thread]);
+            } else {
+                for (size_t i = n * thread / threads; i < n * (thread + 1) / threads; i++) octree.computeForcesAffectingParticle(0, i, particles);
+            }
+        });
+    };
+
+    std::cout << "force walk over " << n << " bodies, " << octree.nodeCount << " nodes, " << NUM_THREADS << " threads\n";
+
+    for (int mode : {FORCE_PARTICLE_WALK, FORCE_GROUP_WALK}) {
+        for (bool stackless : {false, true}) {
+            if (mode == FORCE_GROUP_WALK && !stackless) continue;   // the group walk only exists in the skip pointer form
+            STACKLESS_WALK = stackless;
+
+            double time = timeBest(repetitions, [] {}, [&] { forcePass(mode); });
+
+            std::cout << (mode == FORCE_GROUP_WALK ? "group" : "particle") << (stackless ? ", skip pointers: " : ", recursive: ")
+                      << time << " ms, " << time * 1e6 / n << " ns/body, rms rel. error " << rmsError(particles, exact, stride) << "\n";
+        }
+    }
+    STACKLESS_WALK = true;
+}
+
+// Force error against interactions per body over the opening angle, for the multipole order of this build.
+// Every mode runs with the classic cell size test and with the tight (Salmon-Warren) radius, on the disc and on
+// a uniform cube, so the two opening tests can be compared at equal error.
+static void benchTheta(int count, int repetitions) {
+    const float timeStep = TIME_STEP;
+    const bool counting = countInteractions;
+    const bool tight = TIGHT_BOUNDS;
+    const int forceMode = FORCE_MODE;
+    const bool mutual = MUTUAL_INTERACTIONS;
+    const float theta0 = THETA;
+    TIME_STEP = 0.0f;           // steps only rebuild and evaluate, bodies stay where the reference was taken
+    countInteractions = false;
+
+#ifdef BH_QUADRUPOLE
+    std::cout << "quadrupole nodes";
+#else
+    std::cout << "monopole nodes";
+#endif
+    std::cout << " (" << sizeof(Node) << " bytes, walk nodes " << sizeof(WalkNode) << "), " << count << " bodies, " << NUM_THREADS << " threads\n";
+
+    const char* modeNames[] = {"particle", "group", "dual tree", "dual tree, mutual"};
+
+    for (bool cube : {false, true}) {
+        Simulation simulation;
+        if (cube) ParticleGenerator::createCube(simulation.particles, 0, 0, 0, count, genParticleMass, 0, 0, 0);
+        else simulation.particles = createBodies(count);
+        simulation.step();      // puts the bodies in Morton order once, later steps keep it
+
+        const size_t n = simulation.particles.size();
+        const size_t stride = std::max<size_t>(1, n / 512);
+        const std::vector<std::array<double, 3>> exact = directSample(simulation.particles, stride);
+
+        for (int variant = 0; variant < 4; variant++) {
+            int mode = std::min(variant, (int)FORCE_DUAL_TREE);
+            FORCE_MODE = mode;
+            MUTUAL_INTERACTIONS = variant == 3;
+
+            for (bool tightBounds : {false, true}) {
+                TIGHT_BOUNDS = tightBounds;
+                for (float theta : {0.2f, 0.3f, 0.4f, 0.5f, 0.6f, 0.8f, 1.0f}) {
+                    THETA = theta;
+                    THETA_SQ = theta * theta;
+
+                    simulation.resetTimings();
+                    for (int r = 0; r < repetitions; r++) simulation.step();
+                    double forceTime = simulation.accumulatedTimings[6] / repetitions;
+
+                    // the dual tree counts cell pairs once per pair, not once per body
+                    uint64_t interactions = 0;
+                    if (mode == FORCE_DUAL_TREE) interactions = simulation.dualTree.cellInteractions + simulation.dualTree.directInteractions;
+                    else for (uint32_t cost : simulation.particleCost) interactions += cost;
+
+                    std::cout << (cube ? "cube, " : "disc, ") << modeNames[variant] << (tightBounds ? ", tight" : ", classic") << ", theta " << theta
+                              << ": forces " << forceTime << " ms, " << (double)interactions / n
+                              << " interactions/body, rms rel. error " << rmsError(simulation.particles, exact, stride) << "\n";
+                }
+            }
+        }
+    }
+
+    FORCE_MODE = forceMode;
+    MUTUAL_INTERACTIONS = mutual;
+    TIGHT_BOUNDS = tight;
+    THETA = theta0;
+    THETA_SQ = theta0 * theta0;
+    TIME_STEP = timeStep;
+    countInteractions = counting;
+}
+
+// Block time-steps against one global step small enough for the fastest body, over the same span of time.
+// TIME_STEP is chosen so the body with the largest acceleration needs the finest level. Both runs only refit the
+// tree, so no sort reorders the bodies and slot i is the same body in both.
+static void benchBlockSteps(int count, int repetitions) {
+    const float timeStep = TIME_STEP;
+    const bool blockSteps = BLOCK_TIMESTEPS;
+    const bool refit = TREE_REFIT;
+    const int interval = REFIT_REBUILD_INTERVAL;
+    const float maxGrowth = REFIT_MAX_GROWTH;
+    const int maxLevel = MAX_STEP_LEVEL;
+    const int substeps = 1 << maxLevel;
+
+    // accelerations of the start state, nothing moves
+    Simulation probe;
+    probe.particles = createBodies(count);
+    TIME_STEP = 0.0f;
+    probe.step();
+
+    const ParticleStore& start = probe.particles;
+    const size_t n = start.size();
+    float finest = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < n; i++) {
+        float a = std::sqrt(start.ax[i] * start.ax[i] + start.ay[i] * start.ay[i] + start.az[i] * start.az[i]);
+        if (a > 0.0f) finest = std::min(finest, TIMESTEP_ACCURACY * std::sqrt(EPSILON / a));
+    }
+
+    TREE_REFIT = true;
+    REFIT_REBUILD_INTERVAL = std::numeric_limits<int>::max();
+    REFIT_MAX_GROWTH = std::numeric_limits<float>::max();
+
+    Simulation global, block;
+    BLOCK_TIMESTEPS = false;
+    TIME_STEP = finest;
+    double globalTime = timeBest(repetitions, [&] { global.particles = start; }, [&] {
+        for (int s = 0; s < substeps; s++) global.step();
+    });
+
+    BLOCK_TIMESTEPS = true;
+    TIME_STEP = finest * substeps;
+    double blockTime = timeBest(repetitions, [&] { block.particles = start; }, [&] { block.step(); });
+
+    std::array<size_t, 17> levels = {};
+    double moved = 0.0, apart = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        levels[block.particles.level[i]]++;
+        double gx = global.particles.x[i], gy = global.particles.y[i], gz = global.particles.z[i];
+        moved += (gx - start.x[i]) * (gx - start.x[i]) + (gy - start.y[i]) * (gy - start.y[i]) + (gz - start.z[i]) * (gz - start.z[i]);
+        apart += (gx - block.particles.x[i]) * (gx - block.particles.x[i]) + (gy - block.particles.y[i]) * (gy - block.particles.y[i]) + (gz - block.particles.z[i]) * (gz - block.particles.z[i]);
+    }
+
+    std::cout << "block time-steps over " << n << " bodies, " << substeps << " substeps of " << finest << ", " << NUM_THREADS << " threads\n";
+    std::cout << "levels at the end:";
+    for (int l = 0; l <= maxLevel; l++) std::cout << " " << l << ": " << levels[l];
+    std::cout << "\n";
+    std::cout << "global step " << finest << ", " << substeps << " steps: " << globalTime << " ms\n";
+    std::cout << "block steps, 1 step of " << finest * substeps << ": " << blockTime << " ms (" << globalTime / blockTime << "x), "
+              << ACTIVE_FRACTION * 100.0f << "% active per substep\n";
+    std::cout << "rms position difference / rms displacement: " << std::sqrt(apart / std::max(moved, 1e-30)) << "\n";
+
+    TIME_STEP = timeStep;
+    BLOCK_TIMESTEPS = blockSteps;
+    TREE_REFIT = refit;
+    REFIT_REBUILD_INTERVAL = interval;
+    REFIT_MAX_GROWTH = maxGrowth;
+}
+
+// kinetic + softened potential energy by direct summation in double, O(N^2): meant for ~10^4 bodies
+static double totalEnergy(const ParticleStore& particles) {
+    const size_t n = particles.size();
+    double kinetic = 0.0, potential = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        kinetic += 0.5 * particles.mass[i] * ((double)particles.vx[i] * particles.vx[i] + (double)particles.vy[i] * particles.vy[i] + (double)particles.vz[i] * particles.vz[i]);
+        double sum = 0.0;
+        for (size_t j = i + 1; j < n; j++) {
+            double dx = particles.x[j] - particles.x[i], dy = particles.y[j] - particles.y[i], dz = particles.z[j] - particles.z[i];
+            sum += particles.mass[j] / std::sqrt(dx*dx + dy*dy + dz*dz + EPSILON_SQ);
+        }
+        potential -= G * G_MULTIPLIER * particles.mass[i] * sum;
+    }
+    return kinetic + potential;
+}
+
+// Energy error of each integrator against the CPU time it took, over the same span of simulated time in 16 to 128
+// steps. The span is 128 steps of eta * sqrt(epsilon / max |a|) at the start, the step the controllers would pick.
+// The error is the largest |E - E0| / |E0| seen at 8 checkpoints. The tree's own force error puts a floor under it,
+// a lower theta shows more of the integrators' difference.
+static void benchIntegrators(int count) {
+    const float timeStep = TIME_STEP;
+    const int integrator = INTEGRATOR;
+    const int checkpoints = 8;
+
+    // accelerations of the start state, nothing moves
+    Simulation probe;
+    probe.particles = createBodies(count);
+    TIME_STEP = 0.0f;
+    probe.step();
+    const ParticleStore start = probe.particles;
+    const double span = 128.0 * TIMESTEP_ACCURACY * std::sqrt(EPSILON / std::sqrt(probe.maxAccelerationSq));
+
+    const double startEnergy = totalEnergy(start);
+    std::cout << "integrators over " << start.size() << " bodies, span " << span << ", theta " << THETA << ", " << NUM_THREADS << " threads\n";
+
+    for (int mode : {INTEGRATOR_LEAPFROG, INTEGRATOR_YOSHIDA4}) {
+        INTEGRATOR = mode;
+        const Integrator& scheme = selectIntegrator(mode);
+
+        for (int steps : {16, 32, 64, 128}) {
+            Simulation simulation;
+            simulation.particles = start;
+            TIME_STEP = (float)(span / steps);
+
+            double cpuSeconds = 0.0, maxError = 0.0;
+            for (int c = 1; c <= checkpoints; c++) {
+                std::clock_t t0 = std::clock();
+                for (int s = steps * (c - 1) / checkpoints; s < steps * c / checkpoints; s++) simulation.step();
+                cpuSeconds += (double)(std::clock() - t0) / CLOCKS_PER_SEC;
+                maxError = std::max(maxError, std::abs(totalEnergy(simulation.particles) - startEnergy) / std::abs(startEnergy));
+            }
+
+            std::cout << scheme.name << ", dt " << TIME_STEP << ": " << steps * scheme.stages << " force passes, " << cpuSeconds
+                      << " CPU s, max |dE/E| " << maxError << "\n";
+        }
+    }
+
+    TIME_STEP = timeStep;
+    INTEGRATOR = integrator;
+}
+
+// Force error of every walk against the direct sum over all bodies, not a sample, so the tail of the distribution
+// shows too. The direct engine itself is checked against double precision on a sample. O(N^2): ~10^5 bodies.
+static void benchAccuracy(int count) {
+    const float timeStep = TIME_STEP;
+    const int forceMode = FORCE_MODE;
+    const bool mutual = MUTUAL_INTERACTIONS;
+    const int crossover = DIRECT_CROSSOVER;
+
+    // with no time step the first step only sorts, after that the order and the positions stay put
+    Simulation simulation;
+    simulation.particles = createBodies(count);
+    TIME_STEP = 0.0f;
+    DIRECT_CROSSOVER = 0;
+    FORCE_MODE = FORCE_GROUP_WALK;
+    simulation.step();
+
+    ParticleStore& particles = simulation.particles;
+    const size_t n = particles.size();
+    DirectSummation direct;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    direct.computeForces(particles, simulation.threadPool, NUM_THREADS);
+    double directTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    const std::vector<float> refX(particles.ax.begin(), particles.ax.end());
+    const std::vector<float> refY(particles.ay.begin(), particles.ay.end());
+    const std::vector<float> refZ(particles.az.begin(), particles.az.end());
+
+    const size_t stride = std::max<size_t>(1, n / 512);
+    std::cout << "force accuracy over " << n << " bodies, theta " << THETA << ", " << NUM_THREADS << " threads\n";
+    std::cout << "direct summation (" << (SIMD_LEAF_KERNEL ? leafKernelName(selectLeafKernel()) : "scalar") << "): " << directTime
+              << " ms, rms rel. error against double " << rmsError(particles, directSample(particles, stride), stride) << "\n";
+
+    const char* modeNames[] = {"particle", "group", "dual tree", "dual tree, mutual"};
+    std::vector<double> errors(n);
+    for (int variant = 0; variant < 4; variant++) {
+        FORCE_MODE = std::min(variant, (int)FORCE_DUAL_TREE);
+        MUTUAL_INTERACTIONS = variant == 3;
+        simulation.resetTimings();
+        simulation.step();
+
+        for (size_t i = 0; i < n; i++) {
+            double dx = particles.ax[i] - refX[i], dy = particles.ay[i] - refY[i], dz = particles.az[i] - refZ[i];
+            double ref = std::sqrt((double)refX[i] * refX[i] + (double)refY[i] * refY[i] + (double)refZ[i] * refZ[i]);
+            errors[i] = std::sqrt(dx*dx + dy*dy + dz*dz) / std::max(ref, 1e-30);
+        }
+        double sumSq = 0.0;
+        for (double e : errors) sumSq += e * e;
+        std::sort(errors.begin(), errors.end());
+
+        std::cout << modeNames[variant] << ": forces " << simulation.accumulatedTimings[6] << " ms, rel. error rms " << std::sqrt(sumSq / n)
+                  << ", 99% " << errors[n * 99 / 100] << ", max " << errors.back() << "\n";
+    }
+
+    TIME_STEP = timeStep;
+    FORCE_MODE = forceMode;
+    MUTUAL_INTERACTIONS = mutual;
+    DIRECT_CROSSOVER = crossover;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <sort|resort|morton|kernels|build|walk|theta|blocksteps|integrators|accuracy|crossover> [bodies] [repetitions] [threads]\n";
+        return 1;
+    }
+
+    std::string benchmark = argv[1];
+    int count = argc > 2 ? std::stoi(argv[2]) : 1000000;
+    int repetitions = argc > 3 ? std::stoi(argv[3]) : 5;
+    if (argc > 4) NUM_THREADS = std::max(1, std::stoi(argv[4]));
+
+    if (benchmark == "sort") benchSort(count, repetitions);
+    else if (benchmark == "resort") benchResort(count, repetitions);
+    else if (benchmark == "morton") benchMorton(count, repetitions);
+    else if (benchmark == "kernels") benchKernels(count, repetitions);
+    else if (benchmark == "build") benchBuild(count, repetitions);
+    else if (benchmark == "walk") benchWalk(count, repetitions);
+    else if (benchmark == "theta") benchTheta(count, repetitions);
+    else if (benchmark == "blocksteps") benchBlockSteps(count, repetitions);
+    else if (benchmark == "integrators") benchIntegrators(count);
+    else if (benchmark == "accuracy") benchAccuracy(count);
+    else if (benchmark == "crossover") std::cout << "direct summation is faster below " << Simulation::measureDirectCrossover() << " bodies\n";
+    else {
+        std::cout << "Unknown benchmark: " << benchmark << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <string>
+
+#include "Globals.h"
+#include "Integrator.h"
+#include "Simulation.h"
+#include "SimulationConfig.h"
+
+// Runs the simulation without a window: barnes-hut-sim <config> [steps]
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <config file> [steps]\n";
+        return 1;
+    }
+
+    Simulation simulation;
+    SimulationConfig config;
+    if (!config.load(argv[1], simulation)) return 1;
+    if (argc > 2) config.steps = std::stoi(argv[2]);
+
+    if (DIRECT_CROSSOVER < 0) DIRECT_CROSSOVER = Simulation::measureDirectCrossover();
+
+    std::cout << "Bodies: " << simulation.particles.size() << ", steps: " << config.steps << ", threads: " << NUM_THREADS << "\n";
+    std::cout << "Leaf kernel: " << (SIMD_LEAF_KERNEL ? simulation.octree.leafKernelName() : "scalar") << "\n";
+#ifdef BH_QUADRUPOLE
+    std::cout << "Multipoles: quadrupole\n";
+#else
+    std::cout << "Multipoles: monopole\n";
+#endif
+    const char* walks[] = {"per particle", "group (per leaf)", "dual tree (cell-cell)", "direct (all pairs)"};
+    std::cout << "Force walk: " << walks[FORCE_MODE] << (FORCE_MODE == FORCE_DUAL_TREE && MUTUAL_INTERACTIONS ? ", mutual" : "") << "\n";
+    std::cout << "Direct summation below " << DIRECT_CROSSOVER << " bodies" << (simulation.usesDirectSummation() ? ", no tree" : "") << "\n";
+    std::cout << "Integrator: " << (BLOCK_TIMESTEPS ? "leapfrog, block time-steps" : selectIntegrator(INTEGRATOR).name) << "\n";
+
+    std::ofstream stepLog;
+    if (!config.stepLogPath.empty()) {
+        stepLog.open(config.stepLogPath);
+        if (!stepLog.is_open()) {
+            std::cout << "Failed to write step log: " << config.stepLogPath << "\n";
+            return 1;
+        }
+        stepLog.precision(9);     // enough for the float steps, the times stay apart over long runs
+        stepLog << "step,time,dt\n";
+    }
+
+    auto runStart = std::chrono::steady_clock::now();
+    auto reportStart = runStart;
+    int reportSteps = 0;
+    double reportStartTime = SIMULATED_TIME;
+    float minStep = std::numeric_limits<float>::max(), maxStep = 0.0f;
+
+    for (int step = 1; step <= config.steps; step++) {
+        // the step about to be taken, the controller sets the next one at the end of step()
+        const float stepTaken = TIME_STEP;
+        minStep = std::min(minStep, stepTaken);
+        maxStep = std::max(maxStep, stepTaken);
+        simulation.step();
+        reportSteps++;
+        if (stepLog.is_open()) stepLog << step << ',' << SIMULATED_TIME << ',' << stepTaken << '\n';
+
+        if (config.reportEvery > 0 && (step % config.reportEvery == 0 || step == config.steps)) {
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - reportStart).count();
+
+            std::cout << "\nStep " << step << "/" << config.steps << "\n";
+            std::cout << "Steps/s: " << reportSteps / elapsed << '\n';
+            std::cout << "Nodes: " << simulation.octree.nodeCount << "\n";
+            std::cout << "Last build: " << BUILD_TIME_MS << " ms, " << BUILD_ALLOCATIONS << " allocations; last step: " << STEP_ALLOCATIONS << " allocations\n";
+            if (ADAPTIVE_SORT) {
+                std::cout << "Unsorted keys: " << UNSORTED_KEY_FRACTION * 100.0f << "% (" << (simulation.radixSort.lastSortMerged ? "merge" : "radix") << ")\n";
+            }
+            if (TREE_REFIT) {
+                std::cout << "Leaf growth since last build: " << REFIT_GROWTH << "\n";
+            }
+            if (BLOCK_TIMESTEPS) {
+                std::cout << "Block time-steps: " << (1 << MAX_STEP_LEVEL) << " substeps, " << ACTIVE_FRACTION * 100.0f << "% of the bodies active per substep\n";
+            }
+            if (ADAPTIVE_TIMESTEP) {
+                std::cout << "Time step: " << minStep << " .. " << maxStep << ", next " << TIME_STEP << "; simulated " << SIMULATED_TIME
+                          << " (" << (SIMULATED_TIME - reportStartTime) / elapsed << " per second)\n";
+            }
+            if (countInteractions) {
+                std::cout << "COM interactions: " << COM_INTERACTIONS << ", direct interactions: " << DIRECT_INTERACTIONS << "\n";
+            }
+
+            simulation.printProfiling(std::cout, reportSteps, false);
+
+            reportStart = now;
+            reportSteps = 0;
+            reportStartTime = SIMULATED_TIME;
+            minStep = std::numeric_limits<float>::max();
+            maxStep = 0.0f;
+            simulation.resetTimings();
+        }
+    }
+
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+    std::cout << "\nFinished " << config.steps << " steps in " << total << " s\n";
+
+    return config.writeSnapshot(simulation) ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+// Heap allocations made through operator new since the program started, on every thread.
+// AllocationCounter.cpp replaces the global operator new / delete to count them.
+int64_t heapAllocationCount();
+
+
+
+#endif //ALLOCATIONCOUNTER_H
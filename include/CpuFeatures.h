@@ -0,0 +1,27 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BH_X86 1
+#endif
+
+// target attributes let single functions use instructions the rest of the build was not compiled for,
+// MSVC accepts the intrinsics without them
+#if defined(BH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BMI2_TARGET __attribute__((target("bmi2")))
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#define AVX512_TARGET __attribute__((target("avx512f")))
+#else
+#define BMI2_TARGET
+#define AVX2_TARGET
+#define AVX512_TARGET
+#endif
+
+// runtime checks, include OS support for the wider registers
+bool hasBMI2();
+bool hasAVX2();
+bool hasAVX512();
+
+
+
+#endif //CPUFEATURES_H
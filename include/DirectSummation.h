@@ -0,0 +1,29 @@
+#ifndef DIRECTSUMMATION_H
+#define DIRECTSUMMATION_H
+
+#include <vector>
+
+#include "ForceKernels.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+// Exact O(N^2) forces with the softening (EPSILON_SQ) and G * G_MULTIPLIER of the tree walks. Targets go in blocks
+// and sources in tiles that fit L1, so a tile is loaded once per block instead of once per body. For small N this
+// beats building a tree, and it is the reference the tree's force error is measured against.
+class DirectSummation {
+    static constexpr size_t TARGET_BLOCK = 64;      // bodies per task, their sums stay in registers / L1
+    static constexpr size_t SOURCE_TILE = 1024;     // x, y, z, mass of 1024 bodies: 16 KB
+
+    std::vector<float> threadMaxAccelerationSq;
+    LeafKernel leafKernel = selectLeafKernel();
+
+public:
+    float maxAccelerationSq = 0.0f;     // last computeForces: largest |a|^2
+
+    // writes G * the acceleration of every body to particles.ax/ay/az, no tree needed
+    void computeForces(ParticleStore& particles, ThreadPool& pool, int threadCount);
+};
+
+
+
+#endif //DIRECTSUMMATION_H
@@ -0,0 +1,72 @@
+#ifndef DUALTREE_H
+#define DUALTREE_H
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ForceKernels.h"
+#include "Octree.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+// Field of the far cells around a node's center of mass, to second order:
+// a(com + d) = a + J d + K d d / 2, J symmetric (xx, xy, xz, yy, yz, zz), K = dJ/dr fully symmetric. Without G.
+struct LocalExpansion {
+    float ax, ay, az;
+    float jxx, jxy, jxz, jyy, jyz, jzz;
+    float kxxx, kxxy, kxxz, kxyy, kxyz, kxzz, kyyy, kyyz, kyzz, kzzz;
+};
+
+// Per thread results of the symmetric walk, summed once every task is done.
+struct MutualBuffers {
+    std::vector<LocalExpansion> locals;
+    AlignedVector<float> ax, ay, az;
+};
+
+// Dehnen style dual tree walk over the octree the Barnes-Hut walk uses: pairs of well separated cells
+// interact once through the local expansion of the target cell, which is then pushed down to the bodies.
+// Close leaf pairs are summed directly. Sources are monopoles, the cost grows about linearly with N.
+// Local expansions are second order and cells holding a large share of the mass are never accepted: a point
+// like heavy source (a central black hole) leaves the whole opening test to the target cell, and the error
+// of that target's expansion would then dominate the force on every body around it.
+// With MUTUAL_INTERACTIONS each unordered pair is handled once for both cells (into per thread buffers),
+// which halves the leaf-leaf work.
+class DualTreeSolver {
+    static constexpr int TARGETS_PER_THREAD = 8;
+    static constexpr float HEAVY_CELL_SHARE = 0.25f;    // of the total mass, such cells are always opened
+
+    std::vector<LocalExpansion> locals;                 // one per node
+    std::vector<int> targets;                           // disjoint subtrees covering all bodies, one task each
+    std::vector<int> frontier;                          // scratch for findTargets
+    std::vector<std::vector<std::pair<int, int>>> stacks;   // one per thread
+    std::vector<std::array<int64_t, 2>> counters;       // cell-cell and body-body interactions per thread
+    std::vector<float> threadMaxAccelerationSq;
+    float heavyMass = 0.0f;
+    LeafKernel leafKernel = selectLeafKernel();
+
+    // symmetric mode: every pair of cells is visited once and updates both sides
+    std::vector<std::pair<int, int>> pairTasks;
+    std::vector<std::pair<int, int>> pairFrontier;      // scratch for findPairTasks
+    std::vector<MutualBuffers> buffers;     // one per thread
+
+    void findTargets(const Octree& octree, int threadCount);
+    void interact(const Octree& octree, ParticleStore& particles, int target, std::vector<std::pair<int, int>>& stack, std::array<int64_t, 2>& counter);
+    bool interactMutual(const Octree& octree, const ParticleStore& particles, int a, int b, std::vector<std::pair<int, int>>& stack, MutualBuffers& out, std::array<int64_t, 2>& counter);
+    void findPairTasks(const Octree& octree, const ParticleStore& particles, int threadCount);
+    void computeMutual(const Octree& octree, ParticleStore& particles, ThreadPool& pool, int threadCount);
+    void evaluate(const Octree& octree, ParticleStore& particles, ThreadPool& pool, int threadCount);
+
+public:
+    int64_t cellInteractions = 0;       // last computeForces: accepted cell pairs
+    int64_t directInteractions = 0;     // ... and body pairs summed directly
+    float maxAccelerationSq = 0.0f;     // ... and the largest |a|^2 it left on a body
+
+    // writes G * the acceleration to particles.ax/ay/az, needs buildTree + computeMassDistribution first
+    void computeForces(const Octree& octree, ParticleStore& particles, ThreadPool& pool, int threadCount);
+};
+
+
+
+#endif //DUALTREE_H
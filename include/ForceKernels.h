@@ -0,0 +1,53 @@
+#ifndef FORCEKERNELS_H
+#define FORCEKERNELS_H
+
+#include <cmath>
+
+// Direct (particle-particle) part of the walk: sums mass * d / (|d|^2 + epsilonSq)^(3/2) over the bodies
+// [start, end) of the x/y/z/mass arrays acting on a body at (px, py, pz). The body with index skip
+// (the target itself, -1 for none) is masked out. The sum is not multiplied by G, the caller does that once per leaf.
+using LeafKernel = void (*)(const float* x, const float* y, const float* z, const float* mass,
+                            int start, int end, int skip,
+                            float px, float py, float pz, float epsilonSq,
+                            float& ax, float& ay, float& az);
+
+void leafInteractionsScalar(const float* x, const float* y, const float* z, const float* mass, int start, int end, int skip, float px, float py, float pz, float epsilonSq, float& ax, float& ay, float& az);
+void leafInteractionsAVX2(const float* x, const float* y, const float* z, const float* mass, int start, int end, int skip, float px, float py, float pz, float epsilonSq, float& ax, float& ay, float& az);
+void leafInteractionsAVX512(const float* x, const float* y, const float* z, const float* mass, int start, int end, int skip, float px, float py, float pz, float epsilonSq, float& ax, float& ay, float& az);
+
+// Both sides of every pair between bodies [aStart, aEnd) and [bStart, bEnd): each pull is computed once and added
+// to one body and subtracted from the other (Newton's third law), into ax/ay/az without G. Equal ranges mean one
+// leaf with itself, then only pairs p < q are visited.
+void mutualInteractions(const float* x, const float* y, const float* z, const float* mass,
+                        int aStart, int aEnd, int bStart, int bEnd, float epsilonSq,
+                        float* ax, float* ay, float* az);
+
+// widest kernel the CPU supports, the SIMD kernels use rsqrt refined by one Newton step
+LeafKernel selectLeafKernel();
+const char* leafKernelName(LeafKernel kernel);
+
+// Far field of one cell, without G: (dx, dy, dz) points from the body to the cell's center of mass, distSq is softened.
+// The traceless quadrupole (qzz = -qxx - qyy) adds Q d / r^5 - 5/2 (d Q d) d / r^7 with the sign of d flipped.
+inline void quadrupoleInteraction(float dx, float dy, float dz, float distSq, float mass,
+                                  float qxx, float qxy, float qxz, float qyy, float qyz,
+                                  float& ax, float& ay, float& az) {
+    float invDist = 1.0f / sqrtf(distSq);
+    float invDist2 = invDist * invDist;
+    float invDist3 = invDist * invDist2;
+    float invDist5 = invDist3 * invDist2;
+
+    float qzz = -qxx - qyy;
+    float qdx = qxx * dx + qxy * dy + qxz * dz;
+    float qdy = qxy * dx + qyy * dy + qyz * dz;
+    float qdz = qxz * dx + qyz * dy + qzz * dz;
+    float dqd = dx * qdx + dy * qdy + dz * qdz;
+
+    float radial = mass * invDist3 + 2.5f * dqd * invDist5 * invDist2;
+    ax += dx * radial - qdx * invDist5;
+    ay += dy * radial - qdy * invDist5;
+    az += dz * radial - qdz * invDist5;
+}
+
+
+
+#endif //FORCEKERNELS_H
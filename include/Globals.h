@@ -1,5 +1,6 @@
 #ifndef CONFIG_H
 #define CONFIG_H
+#include <cstdint>
 #include <thread>
 
 inline int SPLIT_AT_LEAF_SIZE = 8;
@@ -17,6 +18,46 @@ inline float TIME_STEP = 1000.0f;
 inline bool ANCHOR = false;
 inline float SPREAD_RADIUS = 50.0f;
 
+enum ForceMode {
+    FORCE_PARTICLE_WALK,    // every body walks the tree on its own
+    FORCE_GROUP_WALK,       // one walk per leaf, shared interaction list
+    FORCE_DUAL_TREE,        // cell-cell interactions through local expansions (DualTreeSolver)
+    FORCE_DIRECT,           // every pair, O(N^2), no tree (DirectSummation)
+};
+inline int FORCE_MODE = FORCE_PARTICLE_WALK;
+inline int DIRECT_CROSSOVER = -1;              // below this many bodies any mode sums directly and skips the tree, -1 = not measured yet
+inline bool TIGHT_BOUNDS = false;             // also open by the bodies' box around the COM (Salmon-Warren) when it reaches past the cell size
+inline bool MUTUAL_INTERACTIONS = false;       // dual tree: each pair once for both sides (Newton's third law)
+
+inline bool SIMD_LEAF_KERNEL = true;           // AVX2/AVX-512 leaf loop when the CPU has it
+inline bool STACKLESS_WALK = true;             // skip pointer walk over the flat node array instead of recursion
+inline bool ADAPTIVE_SORT = true;              // merge instead of radix sort when keys are nearly sorted
+inline float ADAPTIVE_SORT_THRESHOLD = 0.05f;   // max fraction of out-of-order keys for the merge path
+inline float UNSORTED_KEY_FRACTION = 0.0f;
+inline bool TREE_REFIT = false;                // keep the tree between steps, only refit sizes and masses
+inline int REFIT_REBUILD_INTERVAL = 10;        // full rebuild at least every this many steps
+inline float REFIT_MAX_GROWTH = 1.25f;         // ... or once the leaves have grown this much past their cells
+inline float REFIT_GROWTH = 1.0f;
+
+inline bool BLOCK_TIMESTEPS = false;           // per body power of two steps TIME_STEP / 2^level instead of one global step, leapfrog only
+inline int MAX_STEP_LEVEL = 6;                 // finest block step is TIME_STEP / 2^MAX_STEP_LEVEL
+inline float TIMESTEP_ACCURACY = 0.025f;       // eta in the step criterion dt = eta * sqrt(epsilon / |a|)
+inline float ACTIVE_FRACTION = 1.0f;           // share of the bodies that got forces per substep in the last step
+
+enum IntegratorMode {
+    INTEGRATOR_LEAPFROG,    // kick-drift-kick, 2nd order, one force pass per step
+    INTEGRATOR_YOSHIDA4,    // Forest-Ruth / Yoshida triple jump, 4th order, three force passes per step
+};
+inline int INTEGRATOR = INTEGRATOR_LEAPFROG;
+
+inline bool ADAPTIVE_TIMESTEP = false;         // next TIME_STEP from the last force pass: eta * sqrt(epsilon / max |a|)
+inline float MAX_TIME_STEP = 10000.0f;         // ... but never above this
+inline double SIMULATED_TIME = 0.0;
+
+inline double BUILD_TIME_MS = 0.0;              // last full tree build (not refit)
+inline int64_t BUILD_ALLOCATIONS = 0;          // heap allocations during the last build
+inline int64_t STEP_ALLOCATIONS = 0;           // ... and during the whole last step, 0 once every buffer has its size
+
 inline int COM_INTERACTIONS = 0;
 inline int DIRECT_INTERACTIONS = 0;
 
@@ -0,0 +1,22 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <array>
+
+// A symplectic step of dt written as kicks (v += a * c dt) and drifts (x += v * d dt):
+// K(kick[0]) D(drift[0]) K(kick[1]) D(drift[1]) ... D(drift[stages - 1]) K(kick[stages]).
+// Every drift is followed by a full force pass (tree update + forces). The closing kick of a step and the opening
+// kick of the next one use the same forces, so a step costs `stages` force passes.
+struct Integrator {
+    const char* name;
+    int order;
+    int stages;
+    std::array<float, 4> kick;
+    std::array<float, 3> drift;
+};
+
+const Integrator& selectIntegrator(int mode);   // INTEGRATOR_* from Globals.h
+
+
+
+#endif //INTEGRATOR_H
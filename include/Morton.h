@@ -0,0 +1,65 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "Particle.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+using Bounds = std::array<std::pair<float,float>, 3>;
+
+// spreads the low 21 bits of v so that bit i lands on bit 3*i
+inline uint64_t spreadBits3(uint64_t v) {
+    v &= 0x1FFFFFull;
+    v = (v | (v << 32)) & 0x001F00000000FFFFull;
+    v = (v | (v << 16)) & 0x001F0000FF0000FFull;
+    v = (v | (v <<  8)) & 0x100F00F00F00F00Full;
+    v = (v | (v <<  4)) & 0x10C30C30C30C30C3ull;
+    v = (v | (v <<  2)) & 0x1249249249249249ull;
+    return v;
+}
+
+// inverse of spreadBits3
+inline uint32_t compactBits3(uint64_t v) {
+    v &= 0x1249249249249249ull;
+    v = (v | (v >>  2)) & 0x10C30C30C30C30C3ull;
+    v = (v | (v >>  4)) & 0x100F00F00F00F00Full;
+    v = (v | (v >>  8)) & 0x001F0000FF0000FFull;
+    v = (v | (v >> 16)) & 0x001F00000000FFFFull;
+    v = (v | (v >> 32)) & 0x1FFFFFull;
+    return (uint32_t)v;
+}
+
+inline uint64_t encodeMorton(uint32_t xs, uint32_t ys, uint32_t zs) {
+    return spreadBits3(xs) | (spreadBits3(ys) << 1) | (spreadBits3(zs) << 2);
+}
+
+inline void decodeMorton(uint64_t code, uint32_t& xs, uint32_t& ys, uint32_t& zs) {
+    xs = compactBits3(code);
+    ys = compactBits3(code >> 1);
+    zs = compactBits3(code >> 2);
+}
+
+// BMI2 PDEP/PEXT versions, only call them when hasBMI2() is true
+uint64_t encodeMortonBMI2(uint32_t xs, uint32_t ys, uint32_t zs);
+void decodeMortonBMI2(uint64_t code, uint32_t& xs, uint32_t& ys, uint32_t& zs);
+
+unsigned int scale(float f, float fmin, float fmax);
+uint64_t getMortonCodeFrom3D(float x, float y, float z, const Bounds& bounds);
+bool comp(const Particle& a, const Particle& b);
+
+// bounds reduction and the batched scale + encode pass, both split over the thread pool
+Bounds findMinMax(const ParticleStore& particles, ThreadPool& pool, int threadCount);
+void computeMortonCodes(ParticleStore& particles, const Bounds& bounds, ThreadPool& pool, int threadCount);
+
+// codes for count bodies given as separate coordinate arrays, picks PDEP or magic numbers at runtime
+void encodeMortonBatch(const float* x, const float* y, const float* z, uint64_t* codes, size_t count, const Bounds& bounds);
+
+
+
+#endif //MORTON_H
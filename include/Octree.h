@@ -4,16 +4,23 @@
 #include <iostream>
 #include <array>
 #include <algorithm>
-#include "Particle.h"
+#include "ForceKernels.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
 
 
 struct Node {
-    Node(int start, int end, int firstChild, float size) : start(start), end(end), firstChild(firstChild), size(size) {}
+    Node(int start, int end, int firstChild, float size) : start(start), end(end), firstChild(firstChild), numChildren(0), size(size), radius(size), next(-1) {}
 
     int start, end;
     float mass;
     float mcx, mcy, mcz;
     float size;
+    float radius;               // opening radius, set by the mass pass: size, or the reach of the bodies' box from the COM when it is larger
+    int next;                   // where the walk goes once this subtree is done: next sibling or an ancestor's, -1 = end
+#ifdef BH_QUADRUPOLE
+    float qxx, qxy, qxz, qyy, qyz;  // traceless quadrupole about the center of mass, qzz = -qxx - qyy
+#endif
     // int firstChild;
     // int numChildren;
 
@@ -21,20 +28,116 @@ struct Node {
     uint32_t numChildren : 4;
 
     bool isEmpty() const;
-    bool isLeaf();
+    bool isLeaf() const;
+};
+
+// Hot copy of a node for the stackless walks, stored in the order they visit the nodes (depth first): a node's
+// first child is the entry right after it and next is where its subtree ends, so it is a leaf when next is its
+// own index + 1. The build data (Node) stays in its own array, one walk step touches a single 32 byte slot.
+struct alignas(32) WalkNode {
+    float mcx, mcy, mcz, mass;      // center of mass and mass, one float4
+    float radius;                   // opening radius
+    int next;                       // walk index, the array size past the last subtree
+    int start, end;                 // bodies, for leaves and to tell whether a node holds the target
+#ifdef BH_QUADRUPOLE
+    float qxx, qxy, qxz, qyy, qyz;  // 64 bytes with the quadrupole
+#endif
+};
+
+// Interaction list shared by all bodies of one leaf (group walk): accepted cells as point masses
+// and the bodies of opened leaves, in one set of arrays so a single kernel call covers both.
+struct InteractionList {
+    AlignedVector<float> x, y, z, mass;
+#ifdef BH_QUADRUPOLE
+    // cells are kept apart from the bodies, the leaf kernel only knows point masses
+    AlignedVector<float> cellX, cellY, cellZ, cellMass, qxx, qxy, qxz, qyy, qyz;
+#endif
+    int cells = 0;
+    int selfOffset = -1;    // where the leaf's own bodies start in the list
+
+    void clear();
+    void add(float px, float py, float pz, float m);
+    void addCell(const WalkNode& node);
+    int size() const { return (int)x.size(); }
+#ifdef BH_QUADRUPOLE
+    int bodyCount() const { return size(); }
+#else
+    int bodyCount() const { return size() - cells; }
+#endif
 };
 
 class Octree {
+    static constexpr int SUBTREES_PER_THREAD = 8;
+
     std::vector<Node> nodes;
+    std::vector<int> leaves;    // leaf node indices in Morton order
+    AlignedVector<WalkNode> walkNodes;      // hot copy of nodes in walk order, refreshed by every mass pass
+    std::vector<int> walkOrder;             // node index of each walk node
+    std::vector<int> walkIndex;             // walk index of each node
+    LeafKernel leafKernel = selectLeafKernel();
+
+    // parallel build: the top levels are split serially, the subtrees below them are built
+    // into their own arrays and then copied behind the top nodes
+    std::vector<std::pair<int, int>> subtreeRoots;     // (node index, level)
+    std::vector<std::vector<Node>> subtreeNodes;
+    std::vector<std::vector<int>> subtreeLeaves;
+    std::vector<size_t> subtreeOffsets;         // subtree t owns nodes [offsets[t], offsets[t + 1]) besides its root, kept for the mass pass
+    std::vector<size_t> subtreeLeafOffsets;
+    std::vector<std::pair<int, int>> frontier;  // scratch for the serial top levels
+    std::vector<int> subtreeOrder;
+
+    // bodies' bounding box per node (min xyz, max xyz) from the last mass pass, cell sizes of the last build
+    std::vector<std::array<float, 6>> nodeBounds;
+    std::vector<float> cellSizes;
+    int refitsSinceBuild = 0;
+
+    // block time-step substeps: per leaf the mass weighted mean velocity of its bodies and their velocity range
+    // (mean xyz, min xyz, max xyz), and the leaves that have to be summed from their bodies by the predicted pass
+    std::vector<std::array<float, 9>> leafMotion;
+    std::vector<uint8_t> leafKicked;
+    bool predicting = false;
+    float predictStep = 0.0f;
+
+    static size_t estimateNodeCount(size_t bodies);
+    int splitNode(const ParticleStore& particles, std::vector<Node>& out, int nodeIndex, int level);
+    void buildSubtree(const ParticleStore& particles, std::vector<Node>& out, std::vector<int>& outLeaves, int rootLevel);
+    void linkSkipPointers();
+    void orderWalkNodes();
+    void fillWalkNodes(size_t begin, size_t end);
+    void computeNodeMass(int nodeIndex, const ParticleStore& particles);
+    void computeNodeBounds(int nodeIndex, const ParticleStore& particles);
+    void fitNodeRadius(int nodeIndex);
+    bool predictsLeaf(int nodeIndex) const;
+    void predictLeaf(int nodeIndex);
+    void recordLeafMotion(int nodeIndex, const ParticleStore& particles);
+
+    int accumulateForces(int nodeIndex, size_t index, const ParticleStore& particles, float px, float py, float pz, float& ax, float& ay, float& az) const;
+    int walkForces(int nodeIndex, size_t index, const ParticleStore& particles, float px, float py, float pz, float& ax, float& ay, float& az) const;
+    void collectInteractions(int leafIndex, const float boxMin[3], const float boxMax[3], const ParticleStore& particles, InteractionList& list) const;
 
 public:
     int nodeCount = 0;
 
-    float findRootSize(const std::vector<Particle>& particles);
-    void findChildRanges(const std::vector<Particle>& particles, int start, int end, int level, int childStart[8], int childEnd[8]);
-    void buildTree(std::vector<Particle> &sortedParticles);
-    void computeMassDistribution(const std::vector<Particle>& particles);
-    void computeForcesAffectingParticle(int nodeIndex, Particle& particle, const std::vector<Particle>& particles);
+    const char* leafKernelName() const { return ::leafKernelName(leafKernel); }
+
+    float findRootSize(const ParticleStore& particles);
+    void findChildRanges(const ParticleStore& particles, int start, int end, int level, int childStart[8], int childEnd[8]);
+    void buildTree(ParticleStore &sortedParticles);
+    void buildTree(ParticleStore &sortedParticles, ThreadPool& pool, int threadCount);
+    void refit();                   // keeps the last build, computeMassDistribution then refits the node sizes
+    float leafGrowth() const;       // after that mass pass: how much the leaves grew past their cells (1 = not at all)
+    void computeMassDistribution(const ParticleStore& particles);
+    void computeMassDistribution(const ParticleStore& particles, ThreadPool& pool, int threadCount);
+    // the mass pass of a block time-step substep, bodies drifted by dt since the last one: only the leaves holding a
+    // body of kicked (sorted, null = all of them) are summed again, the others follow their bodies' velocities
+    void predictMassDistribution(const ParticleStore& particles, const std::vector<size_t>* kicked, float dt, ThreadPool& pool, int threadCount);
+    // both write (not add) the acceleration of their bodies, so no reset pass is needed before them
+    int computeForcesAffectingParticle(int nodeIndex, size_t index, ParticleStore& particles);   // returns the number of interactions
+    int computeForcesOnLeaf(int leafIndex, ParticleStore& particles, InteractionList& list);     // returns the interactions per body
+
+    const std::vector<int>& getLeaves() const { return leaves; }
+    const Node& getNode(int nodeIndex) const { return nodes[nodeIndex]; }
+    size_t bodyCount() const { return nodes.empty() ? 0 : nodes[0].end; }
 };
 
 
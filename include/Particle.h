@@ -27,22 +27,6 @@ struct Particle {
         return anchored;
     }
 
-    void leapFrogVelStep(float halfTimeStep) {
-        if (isAnchored()) return;
-
-        vx += ax * halfTimeStep;
-        vy += ay * halfTimeStep;
-        vz += az * halfTimeStep;
-    }
-
-    void leapFrogPosStep(float timeStep) {
-        if (isAnchored()) return;
-
-        x += vx * timeStep;
-        y += vy * timeStep;
-        z += vz * timeStep;
-    }
-
     std::string toString() const {
         return std::format(
             "Part{{pos=({:.6f}, {:.6f}, {:.6f}), "
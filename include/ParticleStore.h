@@ -0,0 +1,72 @@
+#ifndef PARTICLESTORE_H
+#define PARTICLESTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "Particle.h"
+#include "ThreadPool.h"
+
+struct SortKey;
+
+// keeps every array on its own cache line boundary so SIMD loads line up
+template<typename T, size_t ALIGNMENT = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>&) {}
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, ALIGNMENT>; };
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(ALIGNMENT));
+    }
+
+    bool operator==(const AlignedAllocator&) const { return true; }
+    bool operator!=(const AlignedAllocator&) const { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Structure of arrays storage for all bodies. Index i of every array is the same body,
+// the Morton sort reorders all arrays together through permute().
+class ParticleStore {
+public:
+    AlignedVector<float> x, y, z;           // position
+    AlignedVector<float> vx, vy, vz;        // velocity
+    AlignedVector<float> ax, ay, az;        // acceleration
+    AlignedVector<float> mass;              // mass
+    AlignedVector<uint64_t> key;            // morton code
+    AlignedVector<uint8_t> anchored;        // anchor
+    AlignedVector<uint8_t> level;           // block time-step level, the body steps by TIME_STEP / 2^level
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+    void clear();
+    void reserve(size_t count);
+    void resize(size_t count);
+
+    void push_back(const Particle& particle);
+    Particle get(size_t i) const;
+
+    // this[i] = source[order[i].index] for every array except the accelerations,
+    // which are always rewritten by the force pass before they are read again
+    void gather(const ParticleStore& source, const std::vector<SortKey>& order, ThreadPool& pool, int threadCount);
+    void swap(ParticleStore& other) noexcept;
+
+    void leapFrogVelStep(float halfTimeStep);
+    void leapFrogPosStep(float timeStep);
+};
+
+
+
+#endif //PARTICLESTORE_H
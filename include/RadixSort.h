@@ -0,0 +1,48 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+struct SortKey {
+    uint64_t key;
+    uint32_t index;
+};
+
+// Parallel LSD radix sort of the 63 bit Morton keys.
+// Only the compact (key, index) pairs move during the passes, the particles are permuted once at the end.
+// Particles move little between steps, so with an adaptive threshold a nearly sorted input
+// skips the radix passes and is repaired by pulling out the out-of-order keys and merging them back.
+class RadixSort {
+public:
+    static constexpr int RADIX_BITS = 11;
+    static constexpr int BUCKETS = 1 << RADIX_BITS;
+    static constexpr int PASSES = (63 + RADIX_BITS - 1) / RADIX_BITS;
+
+private:
+    std::vector<SortKey> keys;
+    std::vector<SortKey> scratch;
+    ParticleStore particleScratch;
+    std::vector<std::array<uint32_t, BUCKETS>> histograms;     // one per thread
+    std::vector<std::vector<SortKey>> outliers;                 // one per thread
+    std::vector<size_t> descents;                               // one per thread
+
+public:
+    float unsortedFraction = 0.0f;     // descents / (n - 1) of the input seen by the last sort()
+    bool lastSortMerged = false;       // last sort() took the near-sorted path
+
+    void sortKeys(std::vector<SortKey>& keys, ThreadPool& pool, int threadCount);
+    size_t countDescents(const std::vector<SortKey>& keys, ThreadPool& pool, int threadCount);
+    void mergeNearlySorted(std::vector<SortKey>& keys, ThreadPool& pool, int threadCount);
+
+    // adaptiveThreshold < 0 always runs the radix passes
+    void sort(ParticleStore& particles, ThreadPool& pool, int threadCount, float adaptiveThreshold = -1.0f);
+};
+
+
+
+#endif //RADIXSORT_H
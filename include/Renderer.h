@@ -11,15 +11,15 @@
 
 #include "Camera.h"
 #include "Octree.h"
-#include "Particle.h"
+#include "ParticleStore.h"
 #include "Shader.h"
 
 class Renderer {
-    std::vector<Particle>* particles;
+    ParticleStore* particles;
     Octree* octree;
     GLFWwindow* window;
     Shader shader;
-    unsigned int VBO;   // Vertex Buffer Object
+    unsigned int VBO[3];    // Vertex Buffer Objects, one per position array (x, y, z)
     unsigned int VAO;   // Vertex Array Object
 
     bool mouseCaptured = true;
@@ -30,8 +30,9 @@ class Renderer {
     static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
     static void mouse_callback(GLFWwindow* window, double x, double y);
     void processInput(GLFWwindow* window);
+    void uploadPositions();
 public:
-    Renderer(std::vector<Particle> &particles, Octree &octtree): particles(&particles), octree(&octtree)  {}
+    Renderer(ParticleStore &particles, Octree &octtree): particles(&particles), octree(&octtree)  {}
     void init();
     void initFrame();
     void prepareImGuiFrame();
@@ -0,0 +1,74 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "DirectSummation.h"
+#include "DualTree.h"
+#include "Globals.h"
+#include "Morton.h"
+#include "Octree.h"
+#include "ParticleStore.h"
+#include "RadixSort.h"
+#include "ThreadPool.h"
+
+// Owns the particles and the octree and advances them one step of the selected integrator at a time.
+// Used by both the windowed application and the headless runner.
+class Simulation {
+public:
+    static constexpr int STAGE_COUNT = 8;   // stage 0 (render) is filled in by the caller
+    static const char* const STAGE_NAMES[STAGE_COUNT];
+    static constexpr int FORCE_BLOCKS_PER_THREAD = 16;
+    static constexpr int LEAVES_PER_CHUNK = 8;      // group walk: leaves taken from the shared counter at once
+    static constexpr int ACTIVE_BODIES_PER_CHUNK = 64;  // block time-steps: active bodies taken at once
+    static constexpr int MAX_DIRECT_CROSSOVER = 32768;  // measureDirectCrossover stops here, direct summation is O(N^2)
+    static constexpr size_t KICK_DRIFT_BLOCK = 1024;    // bodies moved before their bounds are taken, 36 KB of arrays
+
+    ParticleStore particles;
+    Octree octree;
+    ThreadPool threadPool{MAX_HARDWARE_THREADS};   // sized for the thread slider, grows if NUM_THREADS asks for more
+    RadixSort radixSort;
+    DualTreeSolver dualTree;
+    DirectSummation directSummation;
+
+    std::array<double, STAGE_COUNT> accumulatedTimings = {0.0};
+
+    std::vector<uint32_t> particleCost;     // interactions of each Morton slot in the last force pass
+    std::vector<size_t> forceBlocks;        // block boundaries for the force pass, cut at equal cost
+    std::vector<InteractionList> interactionLists;  // one per thread, reused between steps
+    std::vector<float> threadMaxAccelerationSq;     // per thread part of maxAccelerationSq
+    float maxAccelerationSq = 0.0f;                 // largest |a|^2 of the last full force pass
+    std::vector<Bounds> threadBounds;               // per thread part of bodyBounds
+    Bounds bodyBounds;                              // box of the bodies after the last drift, for a rebuild
+    int stepsSinceBuild = 0;                        // steps, not force passes, since the last full build
+
+    // block time-steps: Morton slots whose step ends at the current substep, and the leaves holding them. The
+    // others wait in levelBodies by step level, so a substep only touches the levels it ends.
+    std::vector<size_t> activeBodies;
+    std::vector<int> activeLeaves;
+    std::vector<std::vector<size_t>> levelBodies;
+
+    // times direct and tree forces on discs of growing size, returns the first size where the tree is faster
+    static int measureDirectCrossover();
+
+    bool usesDirectSummation() const;
+    void step();
+    void kickDrift(float kickStep, float driftStep, int threadCount);
+    void kickAll(float kickStep, int threadCount);
+    void blockStep();
+    void rebuildTree();
+    void updateTree();
+    bool updateSubstepTree(const std::vector<size_t>* kicked, float dt);
+    int stepLevel(size_t index, int maxLevel) const;
+    void computeForceBlocks(int threadCount);
+    void computeForces(int threadCount);
+    void computeActiveForces(int threadCount);
+    void printProfiling(std::ostream& out, int frameCount, bool includeRender) const;
+    void resetTimings();
+};
+
+
+#endif //SIMULATION_H
@@ -0,0 +1,22 @@
+#ifndef SIMULATIONCONFIG_H
+#define SIMULATIONCONFIG_H
+
+#include <string>
+
+#include "Simulation.h"
+
+// Plain "key = value" run description for the headless runner.
+// Settings write straight into the globals from Globals.h, scene entries
+// (particle, rectangle, cube, disc, sphere) call the matching ParticleGenerator function.
+struct SimulationConfig {
+    int steps = 1000;
+    int reportEvery = 100;
+    std::string outputPath;
+    std::string stepLogPath;    // headless: one CSV line per step with the time step it took
+
+    bool load(const std::string& path, Simulation& simulation);
+    bool writeSnapshot(const Simulation& simulation) const;
+};
+
+
+#endif //SIMULATIONCONFIG_H
@@ -0,0 +1,52 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Passes over fewer bodies than this run on the calling thread alone: below it waking the workers costs
+// more than the pass itself.
+inline constexpr size_t PARALLEL_MIN_BODIES = 32768;
+
+// Workers stay alive between steps and sleep on a generation word.
+// run() wakes them, the calling thread takes part as worker 0 and returns once every worker is done.
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> generation = 0;   // (epoch << 16) | active thread count
+    std::atomic<int> pending = 0;
+    std::atomic<bool> stopping = false;
+
+    // non-owning view of the caller's callable, unlike std::function it never allocates
+    struct TaskRef {
+        const void* callable;
+        void (*invoke)(const void* callable, int threadIndex, int threadCount);
+    };
+    TaskRef task{};
+
+    void workerLoop(int index);
+    void grow(int threadCount);
+    void runTask(int threadCount, TaskRef job);
+
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // task(threadIndex, threadCount) is called once for every thread index in [0, threadCount)
+    template<typename Task>
+    void run(int threadCount, const Task& job) {
+        runTask(threadCount, {&job, [](const void* callable, int threadIndex, int count) {
+            (*static_cast<const Task*>(callable))(threadIndex, count);
+        }});
+    }
+    int size() const { return (int)workers.size() + 1; }
+};
+
+
+
+#endif //THREADPOOL_H
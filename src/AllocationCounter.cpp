@@ -0,0 +1,53 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The plain and the aligned form are replaced, the array and nothrow forms the standard library
+// provides forward to these two. The sized deletes are defined here as well and forward the same way,
+// so a compiler emitting sized deallocation never reaches the library's own delete.
+
+static std::atomic<int64_t> allocations = 0;
+
+int64_t heapAllocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = (size_t)alignment;
+#ifdef _MSC_VER
+    void* p = _aligned_malloc(size ? size : 1, align);
+#else
+    void* p = std::aligned_alloc(align, (size + align - 1) / align * align + (size == 0 ? align : 0));
+#endif
+    if (p) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
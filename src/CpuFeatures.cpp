@@ -0,0 +1,48 @@
+#include "CpuFeatures.h"
+
+#if defined(BH_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+
+static bool cpuidBit(int leaf, int reg, int bit) {
+    int info[4];
+    __cpuidex(info, leaf, 0);
+    return (info[reg] & (1 << bit)) != 0;
+}
+
+// XCR0 bits the OS has to save for AVX (xmm, ymm) and AVX-512 (opmask, zmm)
+static bool osSaves(unsigned long long mask) {
+    if (!cpuidBit(1, 2, 27)) return false;     // OSXSAVE
+    return (_xgetbv(0) & mask) == mask;
+}
+#endif
+
+bool hasBMI2() {
+#if defined(BH_X86) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("bmi2");
+#elif defined(BH_X86) && defined(_MSC_VER)
+    return cpuidBit(7, 1, 8);
+#else
+    return false;
+#endif
+}
+
+bool hasAVX2() {
+#if defined(BH_X86) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(BH_X86) && defined(_MSC_VER)
+    return cpuidBit(7, 1, 5) && cpuidBit(1, 2, 12) && osSaves(0x6);
+#else
+    return false;
+#endif
+}
+
+bool hasAVX512() {
+#if defined(BH_X86) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("avx512f");
+#elif defined(BH_X86) && defined(_MSC_VER)
+    return cpuidBit(7, 1, 16) && osSaves(0xE6);
+#else
+    return false;
+#endif
+}
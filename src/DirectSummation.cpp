@@ -0,0 +1,59 @@
+#include "DirectSummation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+#include "Globals.h"
+
+void DirectSummation::computeForces(ParticleStore &particles, ThreadPool &pool, int threadCount) {
+    const size_t n = particles.size();
+    const float g = G * G_MULTIPLIER;
+    LeafKernel kernel = SIMD_LEAF_KERNEL ? leafKernel : leafInteractionsScalar;
+    threadMaxAccelerationSq.assign(threadCount, 0.0f);
+
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* z = particles.z.data();
+    const float* mass = particles.mass.data();
+
+    std::atomic<size_t> nextBlock = 0;
+    pool.run(threadCount, [&](int thread, int)
+    {
+        float sx[TARGET_BLOCK], sy[TARGET_BLOCK], sz[TARGET_BLOCK];
+        float maxSq = 0.0f;
+        size_t first;
+        while ((first = nextBlock.fetch_add(TARGET_BLOCK)) < n)
+        {
+            const size_t count = std::min(TARGET_BLOCK, n - first);
+            std::fill_n(sx, count, 0.0f);
+            std::fill_n(sy, count, 0.0f);
+            std::fill_n(sz, count, 0.0f);
+
+            // the kernel masks the target by index, so the tile holding it needs no special case
+            for (size_t tile = 0; tile < n; tile += SOURCE_TILE) {
+                const int tileEnd = (int)std::min(tile + SOURCE_TILE, n);
+                for (size_t t = 0; t < count; t++) {
+                    const size_t p = first + t;
+                    kernel(x, y, z, mass, (int)tile, tileEnd, (int)p, x[p], y[p], z[p], EPSILON_SQ, sx[t], sy[t], sz[t]);
+                }
+            }
+
+            for (size_t t = 0; t < count; t++) {
+                const size_t p = first + t;
+                particles.ax[p] = sx[t] * g;
+                particles.ay[p] = sy[t] * g;
+                particles.az[p] = sz[t] * g;
+                maxSq = std::max(maxSq, particles.ax[p] * particles.ax[p] + particles.ay[p] * particles.ay[p] + particles.az[p] * particles.az[p]);
+            }
+        }
+        threadMaxAccelerationSq[thread] = maxSq;
+    });
+
+    maxAccelerationSq = *std::max_element(threadMaxAccelerationSq.begin(), threadMaxAccelerationSq.end());
+
+    if (countInteractions) {
+        COM_INTERACTIONS = 0;
+        DIRECT_INTERACTIONS = (int)std::min<size_t>(n * (n - 1), std::numeric_limits<int>::max());
+    }
+}
@@ -0,0 +1,402 @@
+#include "DualTree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "Globals.h"
+
+// Field of a unit mass at offset d from the expansion center, distSq = |d|^2 + eps^2:
+// a = d / r^3, J = 3 d d^T / r^5 - I / r^3, K_ijk = 15 d_i d_j d_k / r^7 - 3 (d_i delta_jk + d_j delta_ik + d_k delta_ij) / r^5
+static LocalExpansion unitField(float dx, float dy, float dz, float distSq) {
+    float invDist = 1.0f / sqrtf(distSq);
+    float i3 = invDist * invDist * invDist;
+    float i5 = i3 * invDist * invDist;
+    float i7 = i5 * invDist * invDist;
+    float t5 = 3.0f * i5, t7 = 15.0f * i7;
+
+    LocalExpansion f;
+    f.ax = dx * i3; f.ay = dy * i3; f.az = dz * i3;
+    f.jxx = t5 * dx * dx - i3; f.jxy = t5 * dx * dy; f.jxz = t5 * dx * dz;
+    f.jyy = t5 * dy * dy - i3; f.jyz = t5 * dy * dz; f.jzz = t5 * dz * dz - i3;
+    f.kxxx = dx * (t7 * dx * dx - 3.0f * t5);
+    f.kxxy = dy * (t7 * dx * dx - t5);
+    f.kxxz = dz * (t7 * dx * dx - t5);
+    f.kxyy = dx * (t7 * dy * dy - t5);
+    f.kxyz = t7 * dx * dy * dz;
+    f.kxzz = dx * (t7 * dz * dz - t5);
+    f.kyyy = dy * (t7 * dy * dy - 3.0f * t5);
+    f.kyyz = dz * (t7 * dy * dy - t5);
+    f.kyzz = dy * (t7 * dz * dz - t5);
+    f.kzzz = dz * (t7 * dz * dz - 3.0f * t5);
+    return f;
+}
+
+// local += mass * field. The odd orders (a and K) change sign with the offset, so the partner of a mutual
+// pair, which sees the offset reversed, adds with odd = -1.
+static void addScaled(LocalExpansion& local, const LocalExpansion& field, float mass, float odd) {
+    float m = mass * odd;
+    local.ax += m * field.ax; local.ay += m * field.ay; local.az += m * field.az;
+    local.jxx += mass * field.jxx; local.jxy += mass * field.jxy; local.jxz += mass * field.jxz;
+    local.jyy += mass * field.jyy; local.jyz += mass * field.jyz; local.jzz += mass * field.jzz;
+    local.kxxx += m * field.kxxx; local.kxxy += m * field.kxxy; local.kxxz += m * field.kxxz;
+    local.kxyy += m * field.kxyy; local.kxyz += m * field.kxyz; local.kxzz += m * field.kxzz;
+    local.kyyy += m * field.kyyy; local.kyyz += m * field.kyyz; local.kyzz += m * field.kyzz;
+    local.kzzz += m * field.kzzz;
+}
+
+// a + J d + K d d / 2 at offset d from the expansion center
+static void accelerationAt(const LocalExpansion& l, float dx, float dy, float dz, float& ax, float& ay, float& az) {
+    float xx = 0.5f * dx * dx, yy = 0.5f * dy * dy, zz = 0.5f * dz * dz;
+    float xy = dx * dy, xz = dx * dz, yz = dy * dz;
+    ax = l.ax + l.jxx * dx + l.jxy * dy + l.jxz * dz + l.kxxx * xx + l.kxyy * yy + l.kxzz * zz + l.kxxy * xy + l.kxxz * xz + l.kxyz * yz;
+    ay = l.ay + l.jxy * dx + l.jyy * dy + l.jyz * dz + l.kxxy * xx + l.kyyy * yy + l.kyzz * zz + l.kxyy * xy + l.kxyz * xz + l.kyyz * yz;
+    az = l.az + l.jxz * dx + l.jyz * dy + l.jzz * dz + l.kxxz * xx + l.kyyz * yy + l.kzzz * zz + l.kxyz * xy + l.kxzz * xz + l.kyzz * yz;
+}
+
+// disjoint subtrees covering every body: the top levels are split until there is enough independent work
+void DualTreeSolver::findTargets(const Octree &octree, int threadCount) {
+    targets.assign(1, 0);
+    const size_t wanted = (size_t)threadCount * TARGETS_PER_THREAD;
+    bool splitAny = true;
+
+    while (splitAny && targets.size() < wanted) {
+        std::vector<int>& nextLevel = frontier;
+        nextLevel.clear();
+        splitAny = false;
+
+        for (int nodeIndex : targets) {
+            const Node& node = octree.getNode(nodeIndex);
+            if (node.isLeaf()) {
+                nextLevel.push_back(nodeIndex);
+                continue;
+            }
+
+            splitAny = true;
+            for (int i = 0; i < (int)node.numChildren; i++) {
+                nextLevel.push_back(node.firstChild + i);
+            }
+        }
+        targets.swap(nextLevel);
+    }
+
+    // biggest subtrees are handed out first
+    std::sort(targets.begin(), targets.end(), [&](int a, int b) {
+        const Node& na = octree.getNode(a);
+        const Node& nb = octree.getNode(b);
+        return na.end - na.start > nb.end - nb.start;
+    });
+}
+
+// Every pair (a, b) has its target a inside the task's subtree, so the task is the only one writing
+// a's local expansion and the accelerations of a's bodies. It also clears them before the first direct sum.
+void DualTreeSolver::interact(const Octree &octree, ParticleStore &particles, int target, std::vector<std::pair<int, int>> &stack, std::array<int64_t, 2> &counter) {
+    LeafKernel kernel = SIMD_LEAF_KERNEL ? leafKernel : leafInteractionsScalar;
+    float g = G * G_MULTIPLIER;
+
+    const Node& subtree = octree.getNode(target);
+    std::fill(particles.ax.begin() + subtree.start, particles.ax.begin() + subtree.end, 0.0f);
+    std::fill(particles.ay.begin() + subtree.start, particles.ay.begin() + subtree.end, 0.0f);
+    std::fill(particles.az.begin() + subtree.start, particles.az.begin() + subtree.end, 0.0f);
+
+    stack.clear();
+    stack.push_back({target, 0});
+
+    while (!stack.empty()) {
+        auto [a, b] = stack.back();
+        stack.pop_back();
+
+        const Node& A = octree.getNode(a);
+        const Node& B = octree.getNode(b);
+        if (B.mass == 0 || A.start >= A.end) continue;
+
+        // nodes are either nested or disjoint, nested ones (one is the other's ancestor) are never far apart
+        bool nested = A.start < B.end && B.start < A.end;
+
+        if (!nested) {
+            float dx = B.mcx - A.mcx;
+            float dy = B.mcy - A.mcy;
+            float dz = B.mcz - A.mcz;
+
+            float distSq = dx*dx + dy*dy + dz*dz + EPSILON_SQ;
+            float reach = A.radius + B.radius;
+
+            if (reach * reach < distSq * THETA_SQ && A.mass < heavyMass && B.mass < heavyMass) {
+                addScaled(locals[a], unitField(dx, dy, dz, distSq), B.mass, 1.0f);
+                counter[0]++;
+                continue;
+            }
+        }
+
+        if (A.isLeaf() && B.isLeaf()) {
+            for (int p = A.start; p < A.end; p++) {
+                float sx = 0, sy = 0, sz = 0;
+                kernel(particles.x.data(), particles.y.data(), particles.z.data(), particles.mass.data(), B.start, B.end, p, particles.x[p], particles.y[p], particles.z[p], EPSILON_SQ, sx, sy, sz);
+
+                particles.ax[p] += sx * g;
+                particles.ay[p] += sy * g;
+                particles.az[p] += sz * g;
+            }
+            counter[1] += (int64_t)(A.end - A.start) * (B.end - B.start) - (a == b ? A.end - A.start : 0);
+            continue;
+        }
+
+        if (a == b) {
+            for (int i = 0; i < (int)A.numChildren; i++) {
+                for (int j = 0; j < (int)A.numChildren; j++) {
+                    stack.push_back({A.firstChild + i, A.firstChild + j});
+                }
+            }
+            continue;
+        }
+
+        // open the bigger cell, the target only while the source is no leaf
+        bool splitTarget = B.isLeaf() || (!A.isLeaf() && A.size >= B.size);
+        if (splitTarget) {
+            for (int i = 0; i < (int)A.numChildren; i++) stack.push_back({A.firstChild + i, b});
+        } else {
+            for (int j = 0; j < (int)B.numChildren; j++) stack.push_back({a, B.firstChild + j});
+        }
+    }
+}
+
+// Symmetric version of interact() for one pair: far pairs add to both local expansions, close leaf pairs
+// update both sides, anything else is split onto the stack (a cell with itself into its child pairs p <= q).
+// Returns false when the pair was split.
+bool DualTreeSolver::interactMutual(const Octree &octree, const ParticleStore &particles, int a, int b, std::vector<std::pair<int, int>> &stack, MutualBuffers &out, std::array<int64_t, 2> &counter) {
+    const Node& A = octree.getNode(a);
+    const Node& B = octree.getNode(b);
+    if (A.start >= A.end || B.start >= B.end) return true;
+
+    if (a == b) {
+        if (A.isLeaf()) {
+            mutualInteractions(particles.x.data(), particles.y.data(), particles.z.data(), particles.mass.data(), A.start, A.end, A.start, A.end, EPSILON_SQ, out.ax.data(), out.ay.data(), out.az.data());
+            counter[1] += (int64_t)(A.end - A.start) * (A.end - A.start - 1);
+            return true;
+        }
+        for (int i = 0; i < (int)A.numChildren; i++) {
+            for (int j = i; j < (int)A.numChildren; j++) {
+                stack.push_back({A.firstChild + i, A.firstChild + j});
+            }
+        }
+        return false;
+    }
+
+    // pairs below a cell with itself are always disjoint
+    float dx = B.mcx - A.mcx;
+    float dy = B.mcy - A.mcy;
+    float dz = B.mcz - A.mcz;
+
+    float distSq = dx*dx + dy*dy + dz*dz + EPSILON_SQ;
+    float reach = A.radius + B.radius;
+
+    if (reach * reach < distSq * THETA_SQ && A.mass < heavyMass && B.mass < heavyMass) {
+        // one field for both sides, b sees it from the opposite offset
+        LocalExpansion field = unitField(dx, dy, dz, distSq);
+        addScaled(out.locals[a], field, B.mass, 1.0f);
+        addScaled(out.locals[b], field, A.mass, -1.0f);
+        counter[0] += 2;
+        return true;
+    }
+
+    if (A.isLeaf() && B.isLeaf()) {
+        mutualInteractions(particles.x.data(), particles.y.data(), particles.z.data(), particles.mass.data(), A.start, A.end, B.start, B.end, EPSILON_SQ, out.ax.data(), out.ay.data(), out.az.data());
+        counter[1] += 2 * (int64_t)(A.end - A.start) * (B.end - B.start);
+        return true;
+    }
+
+    // Equal cells are opened on both sides. Opening only one would leave the other's local
+    // expansion spanning a cell bigger than its sources, which the one-sided walk avoids by opening the target.
+    if (!A.isLeaf() && !B.isLeaf() && A.size == B.size) {
+        for (int i = 0; i < (int)A.numChildren; i++) {
+            for (int j = 0; j < (int)B.numChildren; j++) {
+                stack.push_back({A.firstChild + i, B.firstChild + j});
+            }
+        }
+        return false;
+    }
+
+    bool splitA = B.isLeaf() || (!A.isLeaf() && A.size > B.size);
+    if (splitA) {
+        for (int i = 0; i < (int)A.numChildren; i++) stack.push_back({A.firstChild + i, b});
+    } else {
+        for (int j = 0; j < (int)B.numChildren; j++) stack.push_back({a, B.firstChild + j});
+    }
+    return false;
+}
+
+// Splits pairs breadth first, starting from the root with itself, until there are enough open pairs to
+// hand out. Pairs finished on the way land in the first thread's buffers.
+void DualTreeSolver::findPairTasks(const Octree &octree, const ParticleStore &particles, int threadCount) {
+    pairTasks.assign(1, {0, 0});
+    const size_t wanted = (size_t)threadCount * TARGETS_PER_THREAD;
+    std::vector<std::pair<int, int>>& nextLevel = pairFrontier;
+    std::array<int64_t, 2>& counter = counters[0];
+
+    while (!pairTasks.empty() && pairTasks.size() < wanted) {
+        nextLevel.clear();
+        for (auto [a, b] : pairTasks) {
+            interactMutual(octree, particles, a, b, nextLevel, buffers[0], counter);
+        }
+        pairTasks.swap(nextLevel);
+    }
+}
+
+void DualTreeSolver::computeMutual(const Octree &octree, ParticleStore &particles, ThreadPool &pool, int threadCount) {
+    const size_t n = particles.size();
+    if (buffers.size() < (size_t)threadCount) buffers.resize(threadCount);
+
+    pool.run(threadCount, [&](int thread, int)
+    {
+        MutualBuffers& out = buffers[thread];
+        out.locals.assign(octree.nodeCount, LocalExpansion{});
+        out.ax.assign(n, 0.0f);
+        out.ay.assign(n, 0.0f);
+        out.az.assign(n, 0.0f);
+    });
+
+    findPairTasks(octree, particles, threadCount);
+
+    std::atomic<size_t> nextTask = 0;
+    pool.run(threadCount, [&](int thread, int)
+    {
+        std::vector<std::pair<int, int>>& stack = stacks[thread];
+        size_t t;
+        while ((t = nextTask.fetch_add(1)) < pairTasks.size())
+        {
+            stack.clear();
+            stack.push_back(pairTasks[t]);
+            while (!stack.empty()) {
+                auto [a, b] = stack.back();
+                stack.pop_back();
+                interactMutual(octree, particles, a, b, stack, buffers[thread], counters[thread]);
+            }
+        }
+    });
+
+    // sum the per thread results, node and body ranges are split between the threads
+    float g = G * G_MULTIPLIER;
+    pool.run(threadCount, [&](int thread, int threads)
+    {
+        for (size_t i = (size_t)octree.nodeCount * thread / threads; i < (size_t)octree.nodeCount * (thread + 1) / threads; i++) {
+            LocalExpansion sum = {};
+            for (int t = 0; t < threads; t++) {
+                addScaled(sum, buffers[t].locals[i], 1.0f, 1.0f);
+            }
+            locals[i] = sum;
+        }
+
+        for (size_t p = n * thread / threads; p < n * (thread + 1) / threads; p++) {
+            float sx = 0, sy = 0, sz = 0;
+            for (int t = 0; t < threads; t++) {
+                sx += buffers[t].ax[p];
+                sy += buffers[t].ay[p];
+                sz += buffers[t].az[p];
+            }
+            particles.ax[p] = sx * g;
+            particles.ay[p] = sy * g;
+            particles.az[p] = sz * g;
+        }
+    });
+}
+
+// pushes the expansions down to the leaves (children come after their parent), then to the bodies
+void DualTreeSolver::evaluate(const Octree &octree, ParticleStore &particles, ThreadPool &pool, int threadCount) {
+    for (int i = 0; i < octree.nodeCount; i++) {
+        const Node& node = octree.getNode(i);
+        if (node.isLeaf()) continue;
+
+        const LocalExpansion& parent = locals[i];
+        for (int c = 0; c < (int)node.numChildren; c++) {
+            const Node& child = octree.getNode(node.firstChild + c);
+            LocalExpansion& local = locals[node.firstChild + c];
+
+            float dx = child.mcx - node.mcx;
+            float dy = child.mcy - node.mcy;
+            float dz = child.mcz - node.mcz;
+
+            // a' = a + J d + K d d / 2, J' = J + K d, K' = K
+            LocalExpansion moved = parent;
+            accelerationAt(parent, dx, dy, dz, moved.ax, moved.ay, moved.az);
+            moved.jxx += parent.kxxx * dx + parent.kxxy * dy + parent.kxxz * dz;
+            moved.jxy += parent.kxxy * dx + parent.kxyy * dy + parent.kxyz * dz;
+            moved.jxz += parent.kxxz * dx + parent.kxyz * dy + parent.kxzz * dz;
+            moved.jyy += parent.kxyy * dx + parent.kyyy * dy + parent.kyyz * dz;
+            moved.jyz += parent.kxyz * dx + parent.kyyz * dy + parent.kyzz * dz;
+            moved.jzz += parent.kxzz * dx + parent.kyzz * dy + parent.kzzz * dz;
+            addScaled(local, moved, 1.0f, 1.0f);
+        }
+    }
+
+    const std::vector<int>& leaves = octree.getLeaves();
+    float g = G * G_MULTIPLIER;
+
+    // this is the last write of every body's acceleration, so the largest one is taken here
+    threadMaxAccelerationSq.assign(threadCount, 0.0f);
+
+    pool.run(threadCount, [&](int thread, int threads)
+    {
+        float maxSq = 0.0f;
+        for (size_t l = leaves.size() * thread / threads; l < leaves.size() * (thread + 1) / threads; l++)
+        {
+            const Node& leaf = octree.getNode(leaves[l]);
+            const LocalExpansion& local = locals[leaves[l]];
+
+            for (int p = leaf.start; p < leaf.end; p++) {
+                float dx = particles.x[p] - leaf.mcx;
+                float dy = particles.y[p] - leaf.mcy;
+                float dz = particles.z[p] - leaf.mcz;
+
+                float fx, fy, fz;
+                accelerationAt(local, dx, dy, dz, fx, fy, fz);
+
+                float ax = particles.ax[p] + g * fx;
+                float ay = particles.ay[p] + g * fy;
+                float az = particles.az[p] + g * fz;
+                particles.ax[p] = ax;
+                particles.ay[p] = ay;
+                particles.az[p] = az;
+                maxSq = std::max(maxSq, ax*ax + ay*ay + az*az);
+            }
+        }
+        threadMaxAccelerationSq[thread] = maxSq;
+    });
+
+    maxAccelerationSq = *std::max_element(threadMaxAccelerationSq.begin(), threadMaxAccelerationSq.end());
+}
+
+void DualTreeSolver::computeForces(const Octree &octree, ParticleStore &particles, ThreadPool &pool, int threadCount) {
+    cellInteractions = 0;
+    directInteractions = 0;
+    maxAccelerationSq = 0.0f;
+    if (octree.nodeCount == 0 || particles.empty()) return;
+
+    locals.assign(octree.nodeCount, LocalExpansion{});
+    heavyMass = HEAVY_CELL_SHARE * octree.getNode(0).mass;
+    if (stacks.size() < (size_t)threadCount) stacks.resize(threadCount);
+    counters.assign(threadCount, {0, 0});
+
+    if (MUTUAL_INTERACTIONS) {
+        computeMutual(octree, particles, pool, threadCount);
+    }
+    else {
+        findTargets(octree, threadCount);
+
+        std::atomic<size_t> nextTarget = 0;
+        pool.run(threadCount, [&](int thread, int)
+        {
+            size_t t;
+            while ((t = nextTarget.fetch_add(1)) < targets.size())
+            {
+                interact(octree, particles, targets[t], stacks[thread], counters[thread]);
+            }
+        });
+    }
+
+    evaluate(octree, particles, pool, threadCount);
+
+    for (const std::array<int64_t, 2>& counter : counters) {
+        cellInteractions += counter[0];
+        directInteractions += counter[1];
+    }
+}
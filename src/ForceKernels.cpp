@@ -0,0 +1,193 @@
+#include "ForceKernels.h"
+
+#include <cmath>
+
+#include "CpuFeatures.h"
+
+#ifdef BH_X86
+#include <immintrin.h>
+#endif
+
+void leafInteractionsScalar(const float* x, const float* y, const float* z, const float* mass, int start, int end, int skip, float px, float py, float pz, float epsilonSq, float& ax, float& ay, float& az) {
+    for (int p = start; p < end; p++) {
+        if (p == skip) continue;
+
+        float pdx = x[p] - px;
+        float pdy = y[p] - py;
+        float pdz = z[p] - pz;
+
+        float pDistSq = pdx*pdx + pdy*pdy + pdz*pdz + epsilonSq;
+        float pInvDist = 1.0f / sqrtf(pDistSq);
+        float pInvDist3 = pInvDist * pInvDist * pInvDist;
+        float pFactor = mass[p] * pInvDist3;
+
+        ax += pdx * pFactor;
+        ay += pdy * pFactor;
+        az += pdz * pFactor;
+    }
+}
+
+// __restrict: the accumulators never alias the positions, which is what lets the q loop vectorize
+void mutualInteractions(const float* __restrict x, const float* __restrict y, const float* __restrict z, const float* __restrict mass, int aStart, int aEnd, int bStart, int bEnd, float epsilonSq, float* __restrict ax, float* __restrict ay, float* __restrict az) {
+    for (int p = aStart; p < aEnd; p++) {
+        const float px = x[p], py = y[p], pz = z[p], pm = mass[p];
+        float sx = 0, sy = 0, sz = 0;
+
+        for (int q = (aStart == bStart ? p + 1 : bStart); q < bEnd; q++) {
+            float dx = x[q] - px;
+            float dy = y[q] - py;
+            float dz = z[q] - pz;
+
+            float distSq = dx*dx + dy*dy + dz*dz + epsilonSq;
+            float invDist = 1.0f / sqrtf(distSq);
+            float invDist3 = invDist * invDist * invDist;
+
+            sx += dx * mass[q] * invDist3;
+            sy += dy * mass[q] * invDist3;
+            sz += dz * mass[q] * invDist3;
+
+            ax[q] -= dx * pm * invDist3;
+            ay[q] -= dy * pm * invDist3;
+            az[q] -= dz * pm * invDist3;
+        }
+
+        ax[p] += sx;
+        ay[p] += sy;
+        az[p] += sz;
+    }
+}
+
+#ifdef BH_X86
+
+AVX2_TARGET static float horizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+AVX2_TARGET void leafInteractionsAVX2(const float* x, const float* y, const float* z, const float* mass, int start, int end, int skip, float px, float py, float pz, float epsilonSq, float& ax, float& ay, float& az) {
+    const __m256 vpx = _mm256_set1_ps(px);
+    const __m256 vpy = _mm256_set1_ps(py);
+    const __m256 vpz = _mm256_set1_ps(pz);
+    const __m256 veps = _mm256_set1_ps(epsilonSq);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalves = _mm256_set1_ps(1.5f);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i vskip = _mm256_set1_epi32(skip);
+
+    __m256 sx = _mm256_setzero_ps();
+    __m256 sy = _mm256_setzero_ps();
+    __m256 sz = _mm256_setzero_ps();
+
+    for (int i = start; i < end; i += 8) {
+        __m256i inRange = _mm256_cmpgt_epi32(_mm256_set1_epi32(end - i), lane);
+        __m256 bx, by, bz, bm;
+
+        if (end - i >= 8) {
+            bx = _mm256_loadu_ps(x + i);
+            by = _mm256_loadu_ps(y + i);
+            bz = _mm256_loadu_ps(z + i);
+            bm = _mm256_loadu_ps(mass + i);
+        } else {
+            bx = _mm256_maskload_ps(x + i, inRange);
+            by = _mm256_maskload_ps(y + i, inRange);
+            bz = _mm256_maskload_ps(z + i, inRange);
+            bm = _mm256_maskload_ps(mass + i, inRange);
+        }
+
+        __m256 dx = _mm256_sub_ps(bx, vpx);
+        __m256 dy = _mm256_sub_ps(by, vpy);
+        __m256 dz = _mm256_sub_ps(bz, vpz);
+
+        __m256 distSq = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, veps)));
+
+        // rsqrt is good to ~12 bits, one Newton step brings it close to 1 / sqrtf
+        __m256 invDist = _mm256_rsqrt_ps(distSq);
+        invDist = _mm256_mul_ps(invDist, _mm256_fnmadd_ps(_mm256_mul_ps(half, distSq), _mm256_mul_ps(invDist, invDist), threeHalves));
+        __m256 invDist3 = _mm256_mul_ps(invDist, _mm256_mul_ps(invDist, invDist));
+
+        // tail lanes and the target itself contribute nothing, even if their distance is 0
+        __m256i self = _mm256_cmpeq_epi32(_mm256_add_epi32(_mm256_set1_epi32(i), lane), vskip);
+        __m256 valid = _mm256_castsi256_ps(_mm256_andnot_si256(self, inRange));
+        __m256 factor = _mm256_and_ps(_mm256_mul_ps(bm, invDist3), valid);
+
+        sx = _mm256_fmadd_ps(dx, factor, sx);
+        sy = _mm256_fmadd_ps(dy, factor, sy);
+        sz = _mm256_fmadd_ps(dz, factor, sz);
+    }
+
+    ax += horizontalSum(sx);
+    ay += horizontalSum(sy);
+    az += horizontalSum(sz);
+}
+
+AVX512_TARGET void leafInteractionsAVX512(const float* x, const float* y, const float* z, const float* mass, int start, int end, int skip, float px, float py, float pz, float epsilonSq, float& ax, float& ay, float& az) {
+    const __m512 vpx = _mm512_set1_ps(px);
+    const __m512 vpy = _mm512_set1_ps(py);
+    const __m512 vpz = _mm512_set1_ps(pz);
+    const __m512 veps = _mm512_set1_ps(epsilonSq);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 threeHalves = _mm512_set1_ps(1.5f);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i vskip = _mm512_set1_epi32(skip);
+
+    __m512 sx = _mm512_setzero_ps();
+    __m512 sy = _mm512_setzero_ps();
+    __m512 sz = _mm512_setzero_ps();
+
+    for (int i = start; i < end; i += 16) {
+        int remaining = end - i;
+        __mmask16 inRange = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1u);
+
+        __m512 bx = _mm512_maskz_loadu_ps(inRange, x + i);
+        __m512 by = _mm512_maskz_loadu_ps(inRange, y + i);
+        __m512 bz = _mm512_maskz_loadu_ps(inRange, z + i);
+        __m512 bm = _mm512_maskz_loadu_ps(inRange, mass + i);
+
+        __m512 dx = _mm512_sub_ps(bx, vpx);
+        __m512 dy = _mm512_sub_ps(by, vpy);
+        __m512 dz = _mm512_sub_ps(bz, vpz);
+
+        __m512 distSq = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, veps)));
+
+        __m512 invDist = _mm512_rsqrt14_ps(distSq);
+        invDist = _mm512_mul_ps(invDist, _mm512_fnmadd_ps(_mm512_mul_ps(half, distSq), _mm512_mul_ps(invDist, invDist), threeHalves));
+        __m512 invDist3 = _mm512_mul_ps(invDist, _mm512_mul_ps(invDist, invDist));
+
+        __mmask16 valid = inRange & _mm512_cmpneq_epi32_mask(_mm512_add_epi32(_mm512_set1_epi32(i), lane), vskip);
+        __m512 factor = _mm512_maskz_mul_ps(valid, bm, invDist3);
+
+        sx = _mm512_fmadd_ps(dx, factor, sx);
+        sy = _mm512_fmadd_ps(dy, factor, sy);
+        sz = _mm512_fmadd_ps(dz, factor, sz);
+    }
+
+    ax += _mm512_reduce_add_ps(sx);
+    ay += _mm512_reduce_add_ps(sy);
+    az += _mm512_reduce_add_ps(sz);
+}
+
+#else
+
+void leafInteractionsAVX2(const float* x, const float* y, const float* z, const float* mass, int start, int end, int skip, float px, float py, float pz, float epsilonSq, float& ax, float& ay, float& az) {
+    leafInteractionsScalar(x, y, z, mass, start, end, skip, px, py, pz, epsilonSq, ax, ay, az);
+}
+
+void leafInteractionsAVX512(const float* x, const float* y, const float* z, const float* mass, int start, int end, int skip, float px, float py, float pz, float epsilonSq, float& ax, float& ay, float& az) {
+    leafInteractionsScalar(x, y, z, mass, start, end, skip, px, py, pz, epsilonSq, ax, ay, az);
+}
+
+#endif
+
+LeafKernel selectLeafKernel() {
+    if (hasAVX512()) return leafInteractionsAVX512;
+    if (hasAVX2()) return leafInteractionsAVX2;
+    return leafInteractionsScalar;
+}
+
+const char* leafKernelName(LeafKernel kernel) {
+    if (kernel == leafInteractionsAVX512) return "AVX-512";
+    if (kernel == leafInteractionsAVX2) return "AVX2";
+    return "scalar";
+}
@@ -0,0 +1,23 @@
+#include "Integrator.h"
+
+#include <algorithm>
+
+#include "Globals.h"
+
+// Yoshida's triple jump: three leapfrog steps of w1, w0, w1 times dt with w1 = 1 / (2 - 2^(1/3)) and
+// w0 = 1 - 2 w1 (a step backwards) cancel the third order error. Forest and Ruth found the same scheme.
+// Neighbouring half kicks are merged, which leaves 3 force passes per step.
+static constexpr double W1 = 1.3512071919596578;
+static constexpr double W0 = -1.7024143839193153;
+
+static const Integrator INTEGRATORS[] =
+{
+    {"leapfrog (KDK)", 2, 1, {0.5f, 0.5f}, {1.0f}},
+    {"Forest-Ruth / Yoshida 4", 4, 3,
+        {(float)(W1 / 2), (float)((W1 + W0) / 2), (float)((W0 + W1) / 2), (float)(W1 / 2)},
+        {(float)W1, (float)W0, (float)W1}},
+};
+
+const Integrator& selectIntegrator(int mode) {
+    return INTEGRATORS[std::clamp(mode, 0, (int)std::size(INTEGRATORS) - 1)];
+}
@@ -0,0 +1,153 @@
+#include "Morton.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "CpuFeatures.h"
+#include "Globals.h"
+
+#ifdef BH_X86
+#include <immintrin.h>
+#endif
+
+static constexpr uint64_t MORTON_MASK_X = 0x1249249249249249ull;
+static constexpr size_t MORTON_BATCH = 256;
+
+BMI2_TARGET uint64_t encodeMortonBMI2(uint32_t xs, uint32_t ys, uint32_t zs) {
+#ifdef BH_X86
+    return _pdep_u64(xs, MORTON_MASK_X) | _pdep_u64(ys, MORTON_MASK_X << 1) | _pdep_u64(zs, MORTON_MASK_X << 2);
+#else
+    return encodeMorton(xs, ys, zs);
+#endif
+}
+
+BMI2_TARGET void decodeMortonBMI2(uint64_t code, uint32_t& xs, uint32_t& ys, uint32_t& zs) {
+#ifdef BH_X86
+    xs = (uint32_t)_pext_u64(code, MORTON_MASK_X);
+    ys = (uint32_t)_pext_u64(code, MORTON_MASK_X << 1);
+    zs = (uint32_t)_pext_u64(code, MORTON_MASK_X << 2);
+#else
+    decodeMorton(code, xs, ys, zs);
+#endif
+}
+
+unsigned int scale(float f, float fmin, float fmax) {
+
+    float clamped = (f - fmin) / (fmax - fmin);
+
+    if(clamped < 0.f) clamped = 0.f;
+    if(clamped > 1.f) clamped = 1.f;
+    return (unsigned int)(clamped * MORTON_SCALE);
+}
+
+uint64_t getMortonCodeFrom3D(float x, float y, float z, const Bounds& bounds) {
+    uint32_t xs = scale(x, bounds[0].first, bounds[0].second);
+    uint32_t ys = scale(y, bounds[1].first, bounds[1].second);
+    uint32_t zs = scale(z, bounds[2].first, bounds[2].second);
+
+    return encodeMorton(xs, ys, zs);
+}
+
+bool comp(const Particle& a, const Particle& b)
+{
+    return a.Z_CODE < b.Z_CODE;
+}
+
+// per axis offset and 1 / extent, a flat axis maps everything to 0 instead of dividing by zero
+struct AxisScale {
+    float min, invExtent;
+
+    AxisScale(const std::pair<float,float>& axis) : min(axis.first) {
+        float extent = axis.second - axis.first;
+        invExtent = extent > 0.0f ? MORTON_SCALE / extent : 0.0f;
+    }
+
+    uint32_t operator()(float f) const {
+        float s = (f - min) * invExtent;
+        s = std::min(std::max(s, 0.0f), (float)MORTON_SCALE);
+        return (uint32_t)s;
+    }
+};
+
+// plain loops over short arrays so the compiler can vectorize the scale and the magic number spread
+static void encodeBatchMagic(const float* x, const float* y, const float* z, uint64_t* codes, size_t count, const Bounds& bounds) {
+    const AxisScale sx(bounds[0]), sy(bounds[1]), sz(bounds[2]);
+
+    for (size_t i = 0; i < count; i++) {
+        codes[i] = encodeMorton(sx(x[i]), sy(y[i]), sz(z[i]));
+    }
+}
+
+BMI2_TARGET static void encodeBatchBMI2(const float* x, const float* y, const float* z, uint64_t* codes, size_t count, const Bounds& bounds) {
+    const AxisScale sx(bounds[0]), sy(bounds[1]), sz(bounds[2]);
+
+    for (size_t i = 0; i < count; i++) {
+        codes[i] = encodeMortonBMI2(sx(x[i]), sy(y[i]), sz(z[i]));
+    }
+}
+
+void encodeMortonBatch(const float* x, const float* y, const float* z, uint64_t* codes, size_t count, const Bounds& bounds) {
+    static const bool useBMI2 = hasBMI2();
+
+    if (useBMI2) {
+        encodeBatchBMI2(x, y, z, codes, count, bounds);
+    } else {
+        encodeBatchMagic(x, y, z, codes, count, bounds);
+    }
+}
+
+Bounds findMinMax(const ParticleStore& particles, ThreadPool& pool, int threadCount) {
+    const size_t n = particles.size();
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+    threadCount = std::max(1, threadCount);
+
+    // kept between calls so a step allocates nothing here. The workers reach the caller's
+    // buffer through this reference, naming the thread_local in the task would give each its own
+    static thread_local std::vector<Bounds> buffer;
+    std::vector<Bounds>& partial = buffer;
+    partial.resize(threadCount);
+
+    pool.run(threadCount, [&](int thread, int count) {
+        size_t start = n * thread / count;
+        size_t end = n * (thread + 1) / count;
+
+        float minX = std::numeric_limits<float>::max(), maxX = std::numeric_limits<float>::lowest();
+        float minY = minX, maxY = maxX;
+        float minZ = minX, maxZ = maxX;
+
+        const float* x = particles.x.data();
+        const float* y = particles.y.data();
+        const float* z = particles.z.data();
+
+        for (size_t i = start; i < end; i++) {
+            minX = std::min(minX, x[i]); maxX = std::max(maxX, x[i]);
+            minY = std::min(minY, y[i]); maxY = std::max(maxY, y[i]);
+            minZ = std::min(minZ, z[i]); maxZ = std::max(maxZ, z[i]);
+        }
+        partial[thread] = {{{minX, maxX}, {minY, maxY}, {minZ, maxZ}}};
+    });
+
+    Bounds bounds = partial[0];
+    for (int t = 1; t < threadCount; t++) {
+        for (int axis = 0; axis < 3; axis++) {
+            bounds[axis].first = std::min(bounds[axis].first, partial[t][axis].first);
+            bounds[axis].second = std::max(bounds[axis].second, partial[t][axis].second);
+        }
+    }
+    return bounds;
+}
+
+void computeMortonCodes(ParticleStore& particles, const Bounds& bounds, ThreadPool& pool, int threadCount) {
+    const size_t n = particles.size();
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+
+    pool.run(threadCount, [&](int thread, int count) {
+        size_t start = n * thread / count;
+        size_t end = n * (thread + 1) / count;
+
+        for (size_t batch = start; batch < end; batch += MORTON_BATCH) {
+            size_t batchCount = std::min(MORTON_BATCH, end - batch);
+            encodeMortonBatch(&particles.x[batch], &particles.y[batch], &particles.z[batch], &particles.key[batch], batchCount, bounds);
+        }
+    });
+}
@@ -1,10 +1,11 @@
 #include "Octree.h"
 
-#include <stack>
+#include <atomic>
 #include <iostream>
 #include <array>
 #include <algorithm>
 #include <cmath>
+#include <limits>
 
 #include "Globals.h"
 
@@ -13,11 +14,45 @@ bool Node::isEmpty() const {
     return start == -1;
 }
 
-bool Node::isLeaf() {
+bool Node::isLeaf() const {
     return firstChild == -1;
 }
 
-float Octree::findRootSize(const std::vector<Particle>& particles) {
+void InteractionList::clear() {
+    x.clear(); y.clear(); z.clear(); mass.clear();
+#ifdef BH_QUADRUPOLE
+    cellX.clear(); cellY.clear(); cellZ.clear(); cellMass.clear();
+    qxx.clear(); qxy.clear(); qxz.clear(); qyy.clear(); qyz.clear();
+#endif
+    cells = 0;
+    selfOffset = -1;
+}
+
+void InteractionList::add(float px, float py, float pz, float m) {
+    x.push_back(px);
+    y.push_back(py);
+    z.push_back(pz);
+    mass.push_back(m);
+}
+
+void InteractionList::addCell(const WalkNode &node) {
+#ifdef BH_QUADRUPOLE
+    cellX.push_back(node.mcx);
+    cellY.push_back(node.mcy);
+    cellZ.push_back(node.mcz);
+    cellMass.push_back(node.mass);
+    qxx.push_back(node.qxx);
+    qxy.push_back(node.qxy);
+    qxz.push_back(node.qxz);
+    qyy.push_back(node.qyy);
+    qyz.push_back(node.qyz);
+#else
+    add(node.mcx, node.mcy, node.mcz, node.mass);
+#endif
+    cells++;
+}
+
+float Octree::findRootSize(const ParticleStore& particles) {
     std::array<std::pair<float, float>, 3> bounds =
    {{
        {std::numeric_limits<float>::max(),
@@ -30,18 +65,18 @@ float Octree::findRootSize(const std::vector<Particle>& particles) {
         std::numeric_limits<float>::lowest()}
    }};
 
-    for (auto &p : particles) {
+    for (size_t i = 0; i < particles.size(); i++) {
         // x
-        bounds[0].first = std::min(bounds[0].first, p.x);
-        bounds[0].second = std::max(bounds[0].second, p.x);
+        bounds[0].first = std::min(bounds[0].first, particles.x[i]);
+        bounds[0].second = std::max(bounds[0].second, particles.x[i]);
 
         // y
-        bounds[1].first = std::min(bounds[1].first, p.y);
-        bounds[1].second = std::max(bounds[1].second, p.y);
+        bounds[1].first = std::min(bounds[1].first, particles.y[i]);
+        bounds[1].second = std::max(bounds[1].second, particles.y[i]);
 
         // z
-        bounds[2].first = std::min(bounds[2].first, p.z);
-        bounds[2].second = std::max(bounds[2].second, p.z);
+        bounds[2].first = std::min(bounds[2].first, particles.z[i]);
+        bounds[2].second = std::max(bounds[2].second, particles.z[i]);
     }
 
     float dx = bounds[0].second - bounds[0].first;
@@ -56,182 +91,793 @@ float Octree::findRootSize(const std::vector<Particle>& particles) {
     return rootSize;
 }
 
-void Octree::findChildRanges(const std::vector<Particle> &particles, int start, int end, int level, int *childStart, int *childEnd) {
+void Octree::findChildRanges(const ParticleStore &particles, int start, int end, int level, int *childStart, int *childEnd) {
+    int shift = 3 * (21 - level - 1);
+    const uint64_t* keys = particles.key.data();
+
+    // the range is sorted by key and shares every bit above this level, so the octant only grows along it:
+    // 7 binary searches on the keys find where each octant begins
+    int boundary[9];
+    boundary[0] = start;
+    boundary[8] = end;
+
+    for (int octant = 1; octant < 8; octant++) {
+        boundary[octant] = std::partition_point(keys + boundary[octant - 1], keys + end, [&](uint64_t key) {
+            return (int)((key >> shift) & 7) < octant;     // 7 == 0b111
+        }) - keys;
+    }
+
     for (int i = 0; i < 8; i++) {
-        childStart[i] = -1;
-        childEnd[i] = -1;
+        bool occupied = boundary[i] < boundary[i + 1];
+        childStart[i] = occupied ? boundary[i] : -1;
+        childEnd[i] = occupied ? boundary[i + 1] : -1;
     }
+}
 
-    int shift = 3 * (21 - level - 1);
 
-    for (int i = start; i < end; i++) {
-        unsigned int octant = (particles[i].Z_CODE >> shift) & 7;   // 7 == 0b111
+// appends the children of out[nodeIndex] to out, returns how many there are (0 = the node stays a leaf)
+int Octree::splitNode(const ParticleStore &particles, std::vector<Node> &out, int nodeIndex, int level) {
+    int count = out[nodeIndex].end - out[nodeIndex].start;
+
+    if (count <= SPLIT_AT_LEAF_SIZE || level >= MAX_MORTON_BITS) {
+        out[nodeIndex].firstChild = -1;
+        return 0;
+    }
+
+    int childStart[8];
+    int childEnd[8];
+
+    findChildRanges(particles, out[nodeIndex].start, out[nodeIndex].end, level, childStart, childEnd);
+    out[nodeIndex].firstChild = out.size();
+
+    float childSize = out[nodeIndex].size * 0.5f;
+    int childCount = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        if (childStart[i] != -1)
+        {
+            out.push_back(Node(childStart[i], childEnd[i], -1, childSize));
+            childCount++;
+        }
+    }
+    out[nodeIndex].numChildren = childCount;
+    return childCount;
+}
+
+// depth first build below out[0], which the caller has already filled in.
+// Children are pushed in reverse so they are popped in Morton order and the leaves come out sorted.
+// The stack never holds more than 7 waiting siblings per level plus the node being split, so it is a fixed array.
+void Octree::buildSubtree(const ParticleStore &particles, std::vector<Node> &out, std::vector<int> &outLeaves, int rootLevel) {
+    constexpr int STACK_SIZE = 7 * (MAX_MORTON_BITS + 1) + 1;
+    std::array<std::pair<int, int>, STACK_SIZE> stack;
+    int top = 0;
+    stack[top++] = {0, rootLevel};
+
+    while (top > 0) {
 
-        if (childStart[octant] == -1) {
-            childStart[octant] = i;
+        auto [nodeIndex, level] = stack[--top];
+
+        int childCount = splitNode(particles, out, nodeIndex, level);
+        if (childCount == 0) {
+            outLeaves.push_back(nodeIndex);
+            continue;
+        }
+
+        for (int i = childCount - 1; i >= 0; i--) {
+            stack[top++] = {out[nodeIndex].firstChild + i, level + 1};
         }
-        childEnd[octant] = i + 1;
     }
 }
 
+// About 2 bodies per leaf for the leaf sizes in use and 8 / 7 nodes per leaf.
+// Storage only ever grows, so once a build has needed more, later builds reuse it.
+size_t Octree::estimateNodeCount(size_t bodies) {
+    return 2 * bodies / std::max(1, SPLIT_AT_LEAF_SIZE) * 8 / 7 + 1;
+}
 
-void Octree::buildTree(std::vector<Particle>& sortedParticles) {
+void Octree::buildTree(ParticleStore& sortedParticles) {
     nodes.clear();
-    nodeCount = 0;
+    leaves.clear();
     COM_INTERACTIONS = 0;
     DIRECT_INTERACTIONS = 0;
     float rootSize = findRootSize(sortedParticles);
 
-    Node root(0, sortedParticles.size(), -1, rootSize);
-    nodes.push_back(root);
-    nodeCount++;
+    nodes.reserve(estimateNodeCount(sortedParticles.size()));
+    leaves.reserve(estimateNodeCount(sortedParticles.size()));
+    nodes.push_back(Node(0, sortedParticles.size(), -1, rootSize));
+    buildSubtree(sortedParticles, nodes, leaves, 0);
+    nodeCount = nodes.size();
+    refitsSinceBuild = 0;
+    subtreeOffsets.clear();
 
-    std::stack<std::pair<int, int>> stack;
-    stack.push({0, 0});
+    linkSkipPointers();
+    orderWalkNodes();
+}
 
-    while (!stack.empty()) {
+void Octree::buildTree(ParticleStore &sortedParticles, ThreadPool &pool, int threadCount) {
+    size_t n = sortedParticles.size();
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+    if (threadCount <= 1) {
+        buildTree(sortedParticles);
+        return;
+    }
 
-        int nodeIndex = stack.top().first;
-        int level = stack.top().second;
-        stack.pop();
+    nodes.clear();
+    leaves.clear();
+    COM_INTERACTIONS = 0;
+    DIRECT_INTERACTIONS = 0;
+    float rootSize = findRootSize(sortedParticles);
 
-        int count = nodes[nodeIndex].end - nodes[nodeIndex].start;
+    nodes.reserve(estimateNodeCount(n));
+    leaves.reserve(estimateNodeCount(n));
+    nodes.push_back(Node(0, n, -1, rootSize));
+
+    // split level by level until there is enough independent work. Nodes that stay leaves keep their
+    // place in the list (level -1), so the subtrees stay in Morton order and their leaves can simply be concatenated.
+    subtreeRoots.assign(1, {0, 0});
+    const size_t wanted = (size_t)threadCount * SUBTREES_PER_THREAD;
+    bool splitAny = true;
+
+    while (splitAny && subtreeRoots.size() < wanted) {
+        std::vector<std::pair<int, int>>& nextLevel = frontier;
+        nextLevel.clear();
+        splitAny = false;
+
+        for (auto [nodeIndex, level] : subtreeRoots) {
+            int childCount = level < 0 ? 0 : splitNode(sortedParticles, nodes, nodeIndex, level);
+            if (childCount == 0) {
+                nextLevel.push_back({nodeIndex, -1});
+                continue;
+            }
 
-        if (count <= SPLIT_AT_LEAF_SIZE || level >= MAX_MORTON_BITS) {
-            nodes[nodeIndex].firstChild = -1;
-            continue;
+            splitAny = true;
+            for (int i = 0; i < childCount; i++) {
+                nextLevel.push_back({nodes[nodeIndex].firstChild + i, level + 1});
+            }
         }
+        subtreeRoots.swap(nextLevel);
+    }
 
-        int childStart[8];
-        int childEnd[8];
+    // biggest subtrees are handed out first
+    size_t subtreeCount = subtreeRoots.size();
+    std::vector<int>& order = subtreeOrder;
+    order.resize(subtreeCount);
+    for (size_t t = 0; t < subtreeCount; t++) order[t] = t;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        const Node& na = nodes[subtreeRoots[a].first];
+        const Node& nb = nodes[subtreeRoots[b].first];
+        return na.end - na.start > nb.end - nb.start;
+    });
+
+    if (subtreeNodes.size() < subtreeCount) {
+        subtreeNodes.resize(subtreeCount);
+        subtreeLeaves.resize(subtreeCount);
+    }
 
-        findChildRanges(sortedParticles, nodes[nodeIndex].start, nodes[nodeIndex].end, level, childStart, childEnd);
-        nodes[nodeIndex].firstChild = nodes.size();
+    std::atomic<size_t> nextSubtree = 0;
+    pool.run(threadCount, [&](int, int)
+    {
+        size_t t;
+        while ((t = nextSubtree.fetch_add(1)) < subtreeCount)
+        {
+            int task = order[t];
+            std::vector<Node>& out = subtreeNodes[task];
+            out.clear();
+            subtreeLeaves[task].clear();
+
+            const Node& root = nodes[subtreeRoots[task].first];
+            size_t estimate = estimateNodeCount(root.end - root.start);
+            out.reserve(estimate);
+            subtreeLeaves[task].reserve(estimate);
+
+            out.push_back(nodes[subtreeRoots[task].first]);
+            if (subtreeRoots[task].second < 0) subtreeLeaves[task].push_back(0);
+            else buildSubtree(sortedParticles, out, subtreeLeaves[task], subtreeRoots[task].second);
+        }
+    });
+
+    // each subtree's root replaces its top node, the rest goes behind the top levels in subtree order
+    subtreeOffsets.resize(subtreeCount + 1);
+    subtreeLeafOffsets.resize(subtreeCount + 1);
+    subtreeOffsets[0] = nodes.size();
+    subtreeLeafOffsets[0] = leaves.size();
+    for (size_t t = 0; t < subtreeCount; t++) {
+        subtreeOffsets[t + 1] = subtreeOffsets[t] + subtreeNodes[t].size() - 1;
+        subtreeLeafOffsets[t + 1] = subtreeLeafOffsets[t] + subtreeLeaves[t].size();
+    }
 
-        float childSize = nodes[nodeIndex].size * 0.5f;
-        int childCount = 0;
+    nodes.resize(subtreeOffsets[subtreeCount], Node(-1, -1, -1, 0.0f));
+    leaves.resize(subtreeLeafOffsets[subtreeCount]);
 
-        for (int i = 0; i < 8; i++)
+    std::atomic<size_t> nextCopy = 0;
+    pool.run(threadCount, [&](int, int)
+    {
+        size_t t;
+        while ((t = nextCopy.fetch_add(1)) < subtreeCount)
         {
-            if (childStart[i] != -1)
-            {
-                nodes.push_back(Node(childStart[i], childEnd[i], -1, childSize));
-                nodeCount++;
+            const std::vector<Node>& local = subtreeNodes[t];
+            int shift = (int)subtreeOffsets[t] - 1;     // local index k > 0 lands at offset + k - 1
+            auto globalIndex = [&](int k) { return k == 0 ? subtreeRoots[t].first : shift + k; };
+
+            for (size_t k = 0; k < local.size(); k++) {
+                Node node = local[k];
+                if (!node.isLeaf()) node.firstChild += shift;
+                nodes[globalIndex(k)] = node;
+            }
 
-                stack.push({nodes[nodeIndex].firstChild + childCount, level + 1});
-                childCount++;
+            for (size_t l = 0; l < subtreeLeaves[t].size(); l++) {
+                leaves[subtreeLeafOffsets[t] + l] = globalIndex(subtreeLeaves[t][l]);
             }
-            nodes[nodeIndex].numChildren = childCount;
+        }
+    });
+    nodeCount = nodes.size();
+    refitsSinceBuild = 0;
+
+    linkSkipPointers();
+    orderWalkNodes();
+}
+
+// children always come after their parent, so the parent's skip pointer is known by the time its children are linked
+void Octree::linkSkipPointers() {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node& node = nodes[i];
+        if (node.isLeaf()) continue;
+
+        for (int c = 0; c < (int)node.numChildren; c++) {
+            int child = node.firstChild + c;
+            nodes[child].next = c + 1 < (int)node.numChildren ? child + 1 : node.next;
         }
     }
 }
 
-void Octree::computeMassDistribution(const std::vector<Particle> &particles) {
-    for (int i = nodes.size() - 1; i >= 0; i--) {
-        Node& node = nodes[i];
-        node.mass = 0;
-        node.mcx = node.mcy = node.mcz = 0;
+// bounding box of the node's bodies (min xyz, max xyz), from the children's boxes for internal nodes
+void Octree::computeNodeBounds(int nodeIndex, const ParticleStore &particles) {
+    const Node& node = nodes[nodeIndex];
+    std::array<float, 6>& box = nodeBounds[nodeIndex];
+    box = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+           std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+
+    if (node.isLeaf()) {
+        for (int p = node.start; p < node.end; p++) {
+            box[0] = std::min(box[0], particles.x[p]); box[3] = std::max(box[3], particles.x[p]);
+            box[1] = std::min(box[1], particles.y[p]); box[4] = std::max(box[4], particles.y[p]);
+            box[2] = std::min(box[2], particles.z[p]); box[5] = std::max(box[5], particles.z[p]);
+        }
+    }
+    else {
+        for (int c = 0; c < (int)node.numChildren; c++) {
+            const std::array<float, 6>& child = nodeBounds[node.firstChild + c];
+            for (int k = 0; k < 3; k++) {
+                box[k] = std::min(box[k], child[k]);
+                box[k + 3] = std::max(box[k + 3], child[k + 3]);
+            }
+        }
+    }
+}
 
-        if (node.isLeaf()) {
-            if (node.isEmpty()) continue;
+// the walk order is the stackless walk with every node opened
+void Octree::orderWalkNodes() {
+    walkOrder.clear();
+    walkOrder.reserve(nodes.size());
+    walkIndex.resize(nodes.size());
 
-            for (int p = node.start; p < node.end; p++) {
-                if (node.start == -1 || node.end == -1) continue;
-                const Particle& particle = particles[p];
+    for (int i = 0; i != -1; i = nodes[i].isLeaf() ? nodes[i].next : (int)nodes[i].firstChild) {
+        walkIndex[i] = walkOrder.size();
+        walkOrder.push_back(i);
+    }
+    walkNodes.resize(walkOrder.size());
+}
 
-                node.mass += particle.mass;
-                node.mcx += particle.x * particle.mass;
-                node.mcy += particle.y * particle.mass;
-                node.mcz += particle.z * particle.mass;
-            }
-            if (node.mass > 0)
-            {
-                node.mcx /= node.mass;
-                node.mcy /= node.mass;
-                node.mcz /= node.mass;
-            }
+// copies the mass pass results of walk nodes [begin, end) out of the build nodes
+void Octree::fillWalkNodes(size_t begin, size_t end) {
+    const int past = (int)walkNodes.size();
+
+    for (size_t k = begin; k < end; k++) {
+        const Node& node = nodes[walkOrder[k]];
+        WalkNode& walk = walkNodes[k];
+
+        walk.mcx = node.mcx;
+        walk.mcy = node.mcy;
+        walk.mcz = node.mcz;
+        walk.mass = node.mass;
+        walk.radius = node.radius;
+        walk.next = node.next == -1 ? past : walkIndex[node.next];
+        walk.start = node.start;
+        walk.end = node.end;
+#ifdef BH_QUADRUPOLE
+        walk.qxx = node.qxx; walk.qxy = node.qxy; walk.qxz = node.qxz; walk.qyy = node.qyy; walk.qyz = node.qyz;
+#endif
+    }
+}
+
+// Keeps the topology of the last build for bodies that have moved since. The next mass pass, which computes
+// the bodies' boxes anyway, makes every node's size the larger of its cell and that box, so the opening test
+// stays conservative.
+void Octree::refit() {
+    COM_INTERACTIONS = 0;
+    DIRECT_INTERACTIONS = 0;
+
+    if (refitsSinceBuild == 0) {
+        cellSizes.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) cellSizes[i] = nodes[i].size;
+    }
+    refitsSinceBuild++;
+}
+
+float Octree::leafGrowth() const {
+    if (refitsSinceBuild == 0) return 1.0f;
+
+    float leafCells = 0.0f, leafSizes = 0.0f;
+    for (int leaf : leaves) {
+        leafCells += cellSizes[leaf];
+        leafSizes += nodes[leaf].size;
+    }
+    return leafCells > 0.0f ? leafSizes / leafCells : 1.0f;
+}
+
+void Octree::computeNodeMass(int nodeIndex, const ParticleStore &particles) {
+    Node& node = nodes[nodeIndex];
+    if (predictsLeaf(nodeIndex)) {
+        predictLeaf(nodeIndex);
+        fitNodeRadius(nodeIndex);
+        return;
+    }
+
+    node.mass = 0;
+    node.mcx = node.mcy = node.mcz = 0;
+#ifdef BH_QUADRUPOLE
+    node.qxx = node.qxy = node.qxz = node.qyy = node.qyz = 0;
+#endif
+
+    if (node.isLeaf()) {
+        if (node.isEmpty()) {
+            node.radius = 0;
+            return;
+        }
+
+        // plain sums over the contiguous SoA range, the compiler turns them into vector reductions
+        const float* x = particles.x.data();
+        const float* y = particles.y.data();
+        const float* z = particles.z.data();
+        const float* m = particles.mass.data();
+        float mass = 0, mx = 0, my = 0, mz = 0;
+
+        for (int p = node.start; p < node.end; p++) {
+            mass += m[p];
+            mx += x[p] * m[p];
+            my += y[p] * m[p];
+            mz += z[p] * m[p];
         }
-        else
+        node.mass = mass;
+
+        if (mass > 0)
         {
-            float totalMass = 0;
-            float cx = 0, cy = 0, cz = 0;
+            node.mcx = mx / mass;
+            node.mcy = my / mass;
+            node.mcz = mz / mass;
+        }
 
-            int first = node.firstChild;
+#ifdef BH_QUADRUPOLE
+        // Q = sum m (3 d d^T - |d|^2 I) with d relative to the center of mass
+        float qxx = 0, qxy = 0, qxz = 0, qyy = 0, qyz = 0;
+        for (int p = node.start; p < node.end; p++) {
+            float dx = x[p] - node.mcx, dy = y[p] - node.mcy, dz = z[p] - node.mcz;
+            float r2 = dx*dx + dy*dy + dz*dz;
+            qxx += m[p] * (3*dx*dx - r2);
+            qxy += m[p] * 3*dx*dy;
+            qxz += m[p] * 3*dx*dz;
+            qyy += m[p] * (3*dy*dy - r2);
+            qyz += m[p] * 3*dy*dz;
+        }
+        node.qxx = qxx; node.qxy = qxy; node.qxz = qxz; node.qyy = qyy; node.qyz = qyz;
+#endif
+        if (predicting) recordLeafMotion(nodeIndex, particles);
+    }
+    else
+    {
+        float totalMass = 0;
+        float cx = 0, cy = 0, cz = 0;
 
-            for (int j = 0; j < node.numChildren; j++)
-            {
-                Node& child = nodes[first + j];
+        int first = node.firstChild;
 
-                totalMass += child.mass;
-                cx += child.mcx * child.mass;
-                cy += child.mcy * child.mass;
-                cz += child.mcz * child.mass;
-            }
-            node.mass = totalMass;
+        for (int j = 0; j < node.numChildren; j++)
+        {
+            Node& child = nodes[first + j];
 
-            if (totalMass > 0)
-            {
-                node.mcx = cx / totalMass;
-                node.mcy = cy / totalMass;
-                node.mcz = cz / totalMass;
-            }
+            totalMass += child.mass;
+            cx += child.mcx * child.mass;
+            cy += child.mcy * child.mass;
+            cz += child.mcz * child.mass;
         }
+        node.mass = totalMass;
+
+        if (totalMass > 0)
+        {
+            node.mcx = cx / totalMass;
+            node.mcy = cy / totalMass;
+            node.mcz = cz / totalMass;
+        }
+
+#ifdef BH_QUADRUPOLE
+        // children's quadrupoles moved to the parent's center of mass (parallel axis theorem)
+        float qxx = 0, qxy = 0, qxz = 0, qyy = 0, qyz = 0;
+        for (int j = 0; j < node.numChildren; j++)
+        {
+            const Node& child = nodes[first + j];
+            float dx = child.mcx - node.mcx, dy = child.mcy - node.mcy, dz = child.mcz - node.mcz;
+            float r2 = dx*dx + dy*dy + dz*dz;
+            qxx += child.qxx + child.mass * (3*dx*dx - r2);
+            qxy += child.qxy + child.mass * 3*dx*dy;
+            qxz += child.qxz + child.mass * 3*dx*dz;
+            qyy += child.qyy + child.mass * (3*dy*dy - r2);
+            qyz += child.qyz + child.mass * 3*dy*dz;
+        }
+        node.qxx = qxx; node.qxy = qxy; node.qxz = qxz; node.qyy = qyy; node.qyz = qyz;
+#endif
     }
+
+    computeNodeBounds(nodeIndex, particles);
+    fitNodeRadius(nodeIndex);
 }
 
-void Octree::computeForcesAffectingParticle(int nodeIndex, Particle &particle, const std::vector<Particle> &particles) {
+// node size and opening radius from the bodies' box of the mass pass
+void Octree::fitNodeRadius(int nodeIndex) {
     Node& node = nodes[nodeIndex];
+    if (refitsSinceBuild > 0) {
+        const std::array<float, 6>& box = nodeBounds[nodeIndex];
+        float extent = std::max({box[3] - box[0], box[4] - box[1], box[5] - box[2], 0.0f});
+        node.size = std::max(cellSizes[nodeIndex], extent);
+    }
+    node.radius = node.size;
+
+    // Salmon-Warren: distance from the center of mass to the farthest corner of the bodies' box. It only ever
+    // grows the radius: below the cell size it accepted cells the classic test opens and lost at equal error.
+    if (TIGHT_BOUNDS && node.mass > 0) {
+        const std::array<float, 6>& box = nodeBounds[nodeIndex];
+        float fx = std::max(node.mcx - box[0], box[3] - node.mcx);
+        float fy = std::max(node.mcy - box[1], box[4] - node.mcy);
+        float fz = std::max(node.mcz - box[2], box[5] - node.mcz);
+        node.radius = std::max(node.size, sqrtf(fx*fx + fy*fy + fz*fz));
+    }
+}
 
-    if (node.mass == 0) {
+bool Octree::predictsLeaf(int nodeIndex) const {
+    const Node& node = nodes[nodeIndex];
+    return predicting && node.isLeaf() && !node.isEmpty() && !leafKicked[nodeIndex];
+}
+
+// None of the leaf's bodies was kicked since it was last summed, so each of them drifted by its own v * dt: the
+// center of mass moved by their mass weighted mean velocity and the box by their range, no body is read.
+void Octree::predictLeaf(int nodeIndex) {
+    Node& node = nodes[nodeIndex];
+    const std::array<float, 9>& motion = leafMotion[nodeIndex];
+    std::array<float, 6>& box = nodeBounds[nodeIndex];
+
+    node.mcx += motion[0] * predictStep;
+    node.mcy += motion[1] * predictStep;
+    node.mcz += motion[2] * predictStep;
+    for (int k = 0; k < 3; k++) {
+        box[k] += motion[3 + k] * predictStep;
+        box[k + 3] += motion[6 + k] * predictStep;
+    }
+}
+
+// anchored bodies do not drift, they count with velocity 0 like in the drift itself
+void Octree::recordLeafMotion(int nodeIndex, const ParticleStore &particles) {
+    const Node& node = nodes[nodeIndex];
+    std::array<float, 9>& motion = leafMotion[nodeIndex];
+    motion = {0, 0, 0,
+              std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+              std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+
+    for (int p = node.start; p < node.end; p++) {
+        float free = particles.anchored[p] ? 0.0f : 1.0f;
+        float v[3] = {particles.vx[p] * free, particles.vy[p] * free, particles.vz[p] * free};
+        for (int k = 0; k < 3; k++) {
+            motion[k] += particles.mass[p] * v[k];
+            motion[3 + k] = std::min(motion[3 + k], v[k]);
+            motion[6 + k] = std::max(motion[6 + k], v[k]);
+        }
+    }
+    for (int k = 0; k < 3; k++) motion[k] = node.mass > 0 ? motion[k] / node.mass : 0.0f;
+}
+
+void Octree::computeMassDistribution(const ParticleStore &particles) {
+    nodeBounds.resize(nodes.size());
+    for (int i = nodes.size() - 1; i >= 0; i--) {
+        computeNodeMass(i, particles);
+    }
+    fillWalkNodes(0, walkNodes.size());
+}
+
+// Children always come after their parent, and the parallel build leaves every subtree as one contiguous
+// range behind the top levels: the subtrees are summed in parallel, then the top levels on one thread.
+void Octree::computeMassDistribution(const ParticleStore &particles, ThreadPool &pool, int threadCount) {
+    size_t subtreeCount = subtreeOffsets.empty() ? 0 : subtreeOffsets.size() - 1;
+    if (subtreeCount == 0 || threadCount <= 1) {
+        computeMassDistribution(particles);
         return;
     }
 
-    float dx = node.mcx - particle.x;
-    float dy = node.mcy - particle.y;
-    float dz = node.mcz - particle.z;
+    nodeBounds.resize(nodes.size());
 
-    float distSq = dx*dx + dy*dy + dz*dz + EPSILON_SQ;
-    float sizeSq = node.size * node.size;
+    std::atomic<size_t> nextSubtree = 0;
+    pool.run(threadCount, [&](int, int)
+    {
+        size_t t;
+        while ((t = nextSubtree.fetch_add(1)) < subtreeCount)
+        {
+            for (int i = (int)subtreeOffsets[t + 1] - 1; i >= (int)subtreeOffsets[t]; i--) {
+                computeNodeMass(i, particles);
+            }
+        }
+    });
+
+    for (int i = (int)subtreeOffsets[0] - 1; i >= 0; i--) {
+        computeNodeMass(i, particles);
+    }
+
+    pool.run(threadCount, [&](int thread, int threads)
+    {
+        fillWalkNodes(walkNodes.size() * thread / threads, walkNodes.size() * (thread + 1) / threads);
+    });
+}
+
+// Block time-steps drift every body by the same dt between substeps but only kick the active ones. The internal
+// nodes are still combined from their children, the leaves without a kicked body are predicted instead of summed.
+void Octree::predictMassDistribution(const ParticleStore &particles, const std::vector<size_t>* kicked, float dt, ThreadPool &pool, int threadCount) {
+#ifdef BH_QUADRUPOLE
+    // the quadrupoles do not follow the mean velocity, every leaf is summed again
+    kicked = nullptr;
+#endif
+    leafMotion.resize(nodes.size());
+    leafKicked.assign(nodes.size(), kicked ? 0 : 1);
+
+    // both lists are in Morton order, so one pass finds the leaf of every kicked body
+    if (kicked) {
+        size_t l = 0;
+        for (size_t i : *kicked) {
+            while ((size_t)nodes[leaves[l]].end <= i) l++;
+            leafKicked[leaves[l]] = 1;
+        }
+    }
+
+    predicting = true;
+    predictStep = dt;
+    computeMassDistribution(particles, pool, threadCount);
+    predicting = false;
+}
+
+int Octree::computeForcesAffectingParticle(int nodeIndex, size_t index, ParticleStore &particles) {
+    float ax = 0, ay = 0, az = 0;
+    int interactions = STACKLESS_WALK
+        ? walkForces(nodeIndex, index, particles, particles.x[index], particles.y[index], particles.z[index], ax, ay, az)
+        : accumulateForces(nodeIndex, index, particles, particles.x[index], particles.y[index], particles.z[index], ax, ay, az);
+
+    particles.ax[index] = ax;
+    particles.ay[index] = ay;
+    particles.az[index] = az;
+    return interactions;
+}
+
+int Octree::accumulateForces(int nodeIndex, size_t index, const ParticleStore &particles, float px, float py, float pz, float &ax, float &ay, float &az) const {
+    const Node& node = nodes[nodeIndex];
+
+    if (node.mass == 0) {
+        return 0;
+    }
+
+    float dx = node.mcx - px;
+    float dy = node.mcy - py;
+    float dz = node.mcz - pz;
 
-    if (sizeSq < distSq * THETA_SQ) {
+    float distSq = dx*dx + dy*dy + dz*dz + EPSILON_SQ;
+    float sizeSq = node.radius * node.radius;
+    bool containsTarget = (int)index >= node.start && (int)index < node.end;
+
+    // a tight radius can be below the softening, so a node holding the target itself is always opened
+    if (!containsTarget && sizeSq < distSq * THETA_SQ) {
+#ifdef BH_QUADRUPOLE
+        float sx = 0, sy = 0, sz = 0;
+        quadrupoleInteraction(dx, dy, dz, distSq, node.mass, node.qxx, node.qxy, node.qxz, node.qyy, node.qyz, sx, sy, sz);
+        ax += sx * G * G_MULTIPLIER;
+        ay += sy * G * G_MULTIPLIER;
+        az += sz * G * G_MULTIPLIER;
+#else
         float invDist = 1.0f / sqrtf(distSq);
         float invDist3 = invDist * invDist * invDist;
         float factor = G * G_MULTIPLIER * node.mass * invDist3;
 
-        particle.ax += dx * factor;
-        particle.ay += dy * factor;
-        particle.az += dz * factor;
+        ax += dx * factor;
+        ay += dy * factor;
+        az += dz * factor;
+#endif
 
         if (countInteractions) COM_INTERACTIONS++;
+        return 1;
     }
     else {
         if (node.isLeaf()) {
-            for (int p = node.start; p < node.end; p++) {
-                if (p == -1) continue;
-                const Particle& target = particles[p];
+            LeafKernel kernel = SIMD_LEAF_KERNEL ? leafKernel : leafInteractionsScalar;
+            float sx = 0, sy = 0, sz = 0;
+            kernel(particles.x.data(), particles.y.data(), particles.z.data(), particles.mass.data(), node.start, node.end, (int)index, px, py, pz, EPSILON_SQ, sx, sy, sz);
+
+            float g = G * G_MULTIPLIER;
+            ax += sx * g;
+            ay += sy * g;
+            az += sz * g;
+
+            if (countInteractions) DIRECT_INTERACTIONS += node.end - node.start - ((int)index >= node.start && (int)index < node.end);
+            return node.end - node.start;
+        }
+        else {
+            int interactions = 0;
+            for (int i = 0; i < node.numChildren; i++) {
+                interactions += accumulateForces(node.firstChild + i, index, particles, px, py, pz, ax, ay, az);
+            }
+            return interactions;
+        }
+    }
+}
+
+int Octree::walkForces(int nodeIndex, size_t index, const ParticleStore &particles, float px, float py, float pz, float &ax, float &ay, float &az) const {
+    LeafKernel kernel = SIMD_LEAF_KERNEL ? leafKernel : leafInteractionsScalar;
+    float g = G * G_MULTIPLIER;
+    int interactions = 0;
 
-                if (&target == &particle) continue;
+    // same walk as accumulateForces, but as a linear scan over the walk nodes: step to the next entry
+    // (the first child, or past an opened leaf) or skip the subtree
+    const WalkNode* walk = walkNodes.data();
+    int i = walkIndex[nodeIndex];
+    const int end = walk[i].next;
+    const int target = (int)index;
 
-                float pdx = target.x - particle.x;
-                float pdy = target.y - particle.y;
-                float pdz = target.z - particle.z;
+    while (i != end) {
+        const WalkNode& node = walk[i];
 
-                float pDistSq = pdx*pdx + pdy*pdy + pdz*pdz + EPSILON_SQ;
-                float pInvDist = 1.0f / sqrtf(pDistSq);
-                float pInvDist3 = pInvDist * pInvDist * pInvDist;
-                float pFactor = G * G_MULTIPLIER * target.mass * pInvDist3;
+        if (node.mass == 0) {
+            i = node.next;
+            continue;
+        }
+
+        float dx = node.mcx - px;
+        float dy = node.mcy - py;
+        float dz = node.mcz - pz;
+
+        float distSq = dx*dx + dy*dy + dz*dz + EPSILON_SQ;
+        float sizeSq = node.radius * node.radius;
+        bool containsTarget = target >= node.start && target < node.end;
+
+        if (!containsTarget && sizeSq < distSq * THETA_SQ) {
+#ifdef BH_QUADRUPOLE
+            float sx = 0, sy = 0, sz = 0;
+            quadrupoleInteraction(dx, dy, dz, distSq, node.mass, node.qxx, node.qxy, node.qxz, node.qyy, node.qyz, sx, sy, sz);
+            ax += sx * g;
+            ay += sy * g;
+            az += sz * g;
+#else
+            float invDist = 1.0f / sqrtf(distSq);
+            float invDist3 = invDist * invDist * invDist;
+            float factor = g * node.mass * invDist3;
+
+            ax += dx * factor;
+            ay += dy * factor;
+            az += dz * factor;
+#endif
+
+            if (countInteractions) COM_INTERACTIONS++;
+            interactions++;
+            i = node.next;
+            continue;
+        }
+
+        if (node.next == i + 1) {
+            float sx = 0, sy = 0, sz = 0;
+            kernel(particles.x.data(), particles.y.data(), particles.z.data(), particles.mass.data(), node.start, node.end, target, px, py, pz, EPSILON_SQ, sx, sy, sz);
+
+            ax += sx * g;
+            ay += sy * g;
+            az += sz * g;
+
+            if (countInteractions) DIRECT_INTERACTIONS += node.end - node.start - containsTarget;
+            interactions += node.end - node.start;
+        }
+        i++;
+    }
+    return interactions;
+}
 
-                particle.ax += pdx * pFactor;
-                particle.ay += pdy * pFactor;
-                particle.az += pdz * pFactor;
+void Octree::collectInteractions(int leafIndex, const float boxMin[3], const float boxMax[3], const ParticleStore &particles, InteractionList &list) const {
+    const Node& leaf = nodes[leafIndex];
+    const WalkNode* walk = walkNodes.data();
+    const int end = (int)walkNodes.size();
+    int i = 0;
 
-                if (countInteractions) DIRECT_INTERACTIONS++;
+    while (i != end) {
+        const WalkNode& node = walk[i];
+
+        if (node.mass == 0) {
+            i = node.next;
+            continue;
+        }
+
+        // the leaf and its ancestors are always opened
+        if (node.end <= leaf.start || node.start >= leaf.end) {
+            // closest point of the leaf's bounding box to the center of mass, so the test holds for every body in the leaf
+            float dx = std::max({boxMin[0] - node.mcx, 0.0f, node.mcx - boxMax[0]});
+            float dy = std::max({boxMin[1] - node.mcy, 0.0f, node.mcy - boxMax[1]});
+            float dz = std::max({boxMin[2] - node.mcz, 0.0f, node.mcz - boxMax[2]});
+
+            float distSq = dx*dx + dy*dy + dz*dz + EPSILON_SQ;
+            float sizeSq = node.radius * node.radius;
+
+            if (sizeSq < distSq * THETA_SQ) {
+                list.addCell(node);
+                i = node.next;
+                continue;
             }
         }
-        else {
-            for (int i = 0; i < node.numChildren; i++) {
-                computeForcesAffectingParticle(node.firstChild + i, particle, particles);
+
+        if (node.next == i + 1) {
+            if (node.start == leaf.start) list.selfOffset = list.size();
+
+            for (int p = node.start; p < node.end; p++) {
+                list.add(particles.x[p], particles.y[p], particles.z[p], particles.mass[p]);
             }
         }
+        i++;
+    }
+}
+
+int Octree::computeForcesOnLeaf(int leafIndex, ParticleStore &particles, InteractionList &list) {
+    const Node& leaf = nodes[leafIndex];
+    if (leaf.start >= leaf.end) return 0;
+
+    float boxMin[3] = {particles.x[leaf.start], particles.y[leaf.start], particles.z[leaf.start]};
+    float boxMax[3] = {boxMin[0], boxMin[1], boxMin[2]};
+
+    for (int p = leaf.start + 1; p < leaf.end; p++) {
+        boxMin[0] = std::min(boxMin[0], particles.x[p]); boxMax[0] = std::max(boxMax[0], particles.x[p]);
+        boxMin[1] = std::min(boxMin[1], particles.y[p]); boxMax[1] = std::max(boxMax[1], particles.y[p]);
+        boxMin[2] = std::min(boxMin[2], particles.z[p]); boxMax[2] = std::max(boxMax[2], particles.z[p]);
+    }
+
+    // one walk for the whole leaf
+    list.clear();
+    collectInteractions(leafIndex, boxMin, boxMax, particles, list);
+
+    LeafKernel kernel = SIMD_LEAF_KERNEL ? leafKernel : leafInteractionsScalar;
+    float g = G * G_MULTIPLIER;
+
+    for (int p = leaf.start; p < leaf.end; p++) {
+        int self = list.selfOffset < 0 ? -1 : list.selfOffset + (p - leaf.start);
+        float sx = 0, sy = 0, sz = 0;
+        kernel(list.x.data(), list.y.data(), list.z.data(), list.mass.data(), 0, list.size(), self, particles.x[p], particles.y[p], particles.z[p], EPSILON_SQ, sx, sy, sz);
+
+#ifdef BH_QUADRUPOLE
+        // own accumulators: sx..sz have their address taken by the kernel call, which keeps this loop from vectorizing
+        float qx = 0, qy = 0, qz = 0;
+        const float px = particles.x[p], py = particles.y[p], pz = particles.z[p];
+        for (int c = 0; c < list.cells; c++) {
+            float dx = list.cellX[c] - px;
+            float dy = list.cellY[c] - py;
+            float dz = list.cellZ[c] - pz;
+            float distSq = dx*dx + dy*dy + dz*dz + EPSILON_SQ;
+            quadrupoleInteraction(dx, dy, dz, distSq, list.cellMass[c], list.qxx[c], list.qxy[c], list.qxz[c], list.qyy[c], list.qyz[c], qx, qy, qz);
+        }
+        sx += qx; sy += qy; sz += qz;
+#endif
+
+        particles.ax[p] = sx * g;
+        particles.ay[p] = sy * g;
+        particles.az[p] = sz * g;
+    }
+
+    if (countInteractions) {
+        int bodies = leaf.end - leaf.start;
+        COM_INTERACTIONS += list.cells * bodies;
+        DIRECT_INTERACTIONS += list.bodyCount() * bodies - (list.selfOffset < 0 ? 0 : bodies);
     }
+    return list.bodyCount() + list.cells;
 }
@@ -8,13 +8,13 @@
 
 #include "Globals.h"
 
-void ParticleGenerator::addParticle(std::vector<Particle>& particles, float x, float y, float z, float mass, float vx, float vy, float vz) {
+void ParticleGenerator::addParticle(ParticleStore& particles, float x, float y, float z, float mass, float vx, float vy, float vz) {
     Particle particle(x, y, z, mass, vx, vy, vz);
     if(ANCHOR) particle.setAnchored(true);
     particles.push_back(particle);
 }
 
-void ParticleGenerator::createFlatRectangle(std::vector<Particle>& particles, float x, float y, float z, int count, float particleMass, float vx, float vy, float vz) {
+void ParticleGenerator::createFlatRectangle(ParticleStore& particles, float x, float y, float z, int count, float particleMass, float vx, float vy, float vz) {
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_real_distribution<float> dist(-SPREAD_RADIUS, SPREAD_RADIUS);
@@ -24,7 +24,7 @@ void ParticleGenerator::createFlatRectangle(std::vector<Particle>& particles, fl
     }
 }
 
-void ParticleGenerator::createCube(std::vector<Particle>& particles, float x, float y, float z, int count, float particleMass, float vx, float vy, float vz) {
+void ParticleGenerator::createCube(ParticleStore& particles, float x, float y, float z, int count, float particleMass, float vx, float vy, float vz) {
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_real_distribution<float> dist(-SPREAD_RADIUS, SPREAD_RADIUS);
@@ -34,7 +34,7 @@ void ParticleGenerator::createCube(std::vector<Particle>& particles, float x, fl
     }
 }
 
-void ParticleGenerator::createDisc(std::vector<Particle>& particles, float x, float y, float z, int count, float particleMass, float centerMass, float minR, float maxR, float vx, float vy, float vz) {
+void ParticleGenerator::createDisc(ParticleStore& particles, float x, float y, float z, int count, float particleMass, float centerMass, float minR, float maxR, float vx, float vy, float vz) {
     Particle center(x, y, z, centerMass, vx, vy, vz);
     if(ANCHOR) center.setAnchored(true);
     particles.push_back(center); // center
@@ -59,7 +59,7 @@ void ParticleGenerator::createDisc(std::vector<Particle>& particles, float x, fl
     }
 }
 
-void ParticleGenerator::createSphere(std::vector<Particle>& particles, float x, float y, float z, int count, float particleMass, float centerMass, float minR, float maxR, float vx, float vy, float vz) {
+void ParticleGenerator::createSphere(ParticleStore& particles, float x, float y, float z, int count, float particleMass, float centerMass, float minR, float maxR, float vx, float vy, float vz) {
     Particle center(x, y, z, centerMass, vx, vy, vz);
     if(ANCHOR) center.setAnchored(true);
     particles.push_back(center); // center
@@ -0,0 +1,114 @@
+#include "ParticleStore.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "RadixSort.h"
+
+void ParticleStore::clear() {
+    resize(0);
+}
+
+void ParticleStore::reserve(size_t count) {
+    x.reserve(count); y.reserve(count); z.reserve(count);
+    vx.reserve(count); vy.reserve(count); vz.reserve(count);
+    ax.reserve(count); ay.reserve(count); az.reserve(count);
+    mass.reserve(count);
+    key.reserve(count);
+    anchored.reserve(count);
+    level.reserve(count);
+}
+
+void ParticleStore::resize(size_t count) {
+    x.resize(count); y.resize(count); z.resize(count);
+    vx.resize(count); vy.resize(count); vz.resize(count);
+    ax.resize(count); ay.resize(count); az.resize(count);
+    mass.resize(count);
+    key.resize(count);
+    anchored.resize(count);
+    level.resize(count);
+}
+
+void ParticleStore::push_back(const Particle& particle) {
+    x.push_back(particle.x); y.push_back(particle.y); z.push_back(particle.z);
+    vx.push_back(particle.vx); vy.push_back(particle.vy); vz.push_back(particle.vz);
+    ax.push_back(particle.ax); ay.push_back(particle.ay); az.push_back(particle.az);
+    mass.push_back(particle.mass);
+    key.push_back(particle.Z_CODE);
+    anchored.push_back(particle.isAnchored());
+    level.push_back(0);
+}
+
+Particle ParticleStore::get(size_t i) const {
+    Particle particle(x[i], y[i], z[i], mass[i], vx[i], vy[i], vz[i]);
+    particle.ax = ax[i];
+    particle.ay = ay[i];
+    particle.az = az[i];
+    particle.Z_CODE = key[i];
+    particle.setAnchored(anchored[i]);
+    return particle;
+}
+
+template<typename T>
+static void gatherArray(T* dst, const T* src, const SortKey* order, size_t start, size_t end) {
+    for (size_t i = start; i < end; i++) {
+        dst[i] = src[order[i].index];
+    }
+}
+
+void ParticleStore::gather(const ParticleStore& source, const std::vector<SortKey>& order, ThreadPool& pool, int threadCount) {
+    const size_t n = source.size();
+    resize(n);
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+
+    pool.run(threadCount, [&](int thread, int count) {
+        size_t start = n * thread / count;
+        size_t end = n * (thread + 1) / count;
+        const SortKey* o = order.data();
+
+        // one array at a time keeps the writes streaming
+        gatherArray(x.data(), source.x.data(), o, start, end);
+        gatherArray(y.data(), source.y.data(), o, start, end);
+        gatherArray(z.data(), source.z.data(), o, start, end);
+        gatherArray(vx.data(), source.vx.data(), o, start, end);
+        gatherArray(vy.data(), source.vy.data(), o, start, end);
+        gatherArray(vz.data(), source.vz.data(), o, start, end);
+        gatherArray(mass.data(), source.mass.data(), o, start, end);
+        gatherArray(anchored.data(), source.anchored.data(), o, start, end);
+        gatherArray(level.data(), source.level.data(), o, start, end);
+
+        for (size_t i = start; i < end; i++) {
+            key[i] = order[i].key;
+        }
+    });
+}
+
+void ParticleStore::swap(ParticleStore& other) noexcept {
+    x.swap(other.x); y.swap(other.y); z.swap(other.z);
+    vx.swap(other.vx); vy.swap(other.vy); vz.swap(other.vz);
+    ax.swap(other.ax); ay.swap(other.ay); az.swap(other.az);
+    mass.swap(other.mass);
+    key.swap(other.key);
+    anchored.swap(other.anchored);
+    level.swap(other.level);
+}
+
+void ParticleStore::leapFrogVelStep(float halfTimeStep) {
+    const size_t n = size();
+    for (size_t i = 0; i < n; i++) {
+        float dt = anchored[i] ? 0.0f : halfTimeStep;
+        vx[i] += ax[i] * dt;
+        vy[i] += ay[i] * dt;
+        vz[i] += az[i] * dt;
+    }
+}
+
+void ParticleStore::leapFrogPosStep(float timeStep) {
+    const size_t n = size();
+    for (size_t i = 0; i < n; i++) {
+        float dt = anchored[i] ? 0.0f : timeStep;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        z[i] += vz[i] * dt;
+    }
+}
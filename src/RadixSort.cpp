@@ -0,0 +1,171 @@
+#include "RadixSort.h"
+
+#include <algorithm>
+#include <utility>
+
+void RadixSort::sortKeys(std::vector<SortKey>& data, ThreadPool& pool, int threadCount) {
+    const size_t n = data.size();
+    if (n < 2) return;
+
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+    threadCount = std::max(1, threadCount);
+
+    scratch.resize(n);
+    histograms.resize(threadCount);
+
+    for (int pass = 0; pass < PASSES; pass++) {
+        const int shift = pass * RADIX_BITS;
+
+        // histogram per thread over its own contiguous chunk
+        pool.run(threadCount, [&](int thread, int count) {
+            size_t start = n * thread / count;
+            size_t end = n * (thread + 1) / count;
+
+            auto& histogram = histograms[thread];
+            histogram.fill(0);
+            for (size_t i = start; i < end; i++) {
+                histogram[(data[i].key >> shift) & (BUCKETS - 1)]++;
+            }
+        });
+
+        // prefix sum, digit-major then thread-major keeps the scatter stable
+        bool allInOneBucket = false;
+        uint32_t offset = 0;
+        for (int digit = 0; digit < BUCKETS; digit++) {
+            uint32_t digitTotal = 0;
+            for (int t = 0; t < threadCount; t++) {
+                uint32_t c = histograms[t][digit];
+                histograms[t][digit] = offset;
+                offset += c;
+                digitTotal += c;
+            }
+            if (digitTotal == n) allInOneBucket = true;
+        }
+        if (allInOneBucket) continue;   // this digit is the same for every key
+
+        pool.run(threadCount, [&](int thread, int count) {
+            size_t start = n * thread / count;
+            size_t end = n * (thread + 1) / count;
+
+            auto& offsets = histograms[thread];
+            for (size_t i = start; i < end; i++) {
+                scratch[offsets[(data[i].key >> shift) & (BUCKETS - 1)]++] = data[i];
+            }
+        });
+
+        std::swap(data, scratch);
+    }
+}
+
+size_t RadixSort::countDescents(const std::vector<SortKey>& data, ThreadPool& pool, int threadCount) {
+    const size_t n = data.size();
+    if (n < 2) return 0;
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+    threadCount = std::max(1, threadCount);
+
+    descents.assign(threadCount, 0);
+    pool.run(threadCount, [&](int thread, int count) {
+        size_t start = std::max<size_t>(1, n * thread / count);
+        size_t end = n * (thread + 1) / count;
+
+        size_t local = 0;
+        for (size_t i = start; i < end; i++) {
+            local += data[i - 1].key > data[i].key;
+        }
+        descents[thread] = local;
+    });
+
+    size_t total = 0;
+    for (size_t d : descents) total += d;
+    return total;
+}
+
+void RadixSort::mergeNearlySorted(std::vector<SortKey>& data, ThreadPool& pool, int threadCount) {
+    const size_t n = data.size();
+    if (n < 2) return;
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+    threadCount = std::max(1, threadCount);
+
+    auto byKey = [](const SortKey& a, const SortKey& b) { return a.key < b.key; };
+
+    scratch.resize(n);
+    outliers.resize(threadCount);
+
+    // every chunk keeps an ascending subsequence in place, each key that breaks it is pulled out
+    // together with the kept key it collided with, sorted separately and merged back in
+    pool.run(threadCount, [&](int thread, int count) {
+        size_t start = n * thread / count;
+        size_t end = n * (thread + 1) / count;
+
+        auto& out = outliers[thread];
+        out.clear();
+
+        size_t kept = start;
+        for (size_t i = start; i < end; i++) {
+            if (kept > start && data[kept - 1].key > data[i].key) {
+                out.push_back(data[--kept]);
+                out.push_back(data[i]);
+            } else {
+                data[kept++] = data[i];
+            }
+        }
+
+        std::sort(out.begin(), out.end(), byKey);
+        std::merge(data.begin() + start, data.begin() + kept, out.begin(), out.end(), scratch.begin() + start, byKey);
+    });
+
+    // pairwise merge of the sorted chunks, one level per pass
+    std::vector<SortKey>* src = &scratch;
+    std::vector<SortKey>* dst = &data;
+
+    for (int width = 1; width < threadCount; width *= 2) {
+        int pairs = (threadCount + 2 * width - 1) / (2 * width);
+
+        pool.run(std::min(pairs, threadCount), [&](int thread, int count) {
+            for (int pair = thread; pair < pairs; pair += count) {
+                size_t first = n * (size_t)(2 * pair * width) / threadCount;
+                size_t middle = n * (size_t)std::min(threadCount, (2 * pair + 1) * width) / threadCount;
+                size_t last = n * (size_t)std::min(threadCount, (2 * pair + 2) * width) / threadCount;
+
+                std::merge(src->begin() + first, src->begin() + middle,
+                           src->begin() + middle, src->begin() + last,
+                           dst->begin() + first, byKey);
+            }
+        });
+        std::swap(src, dst);
+    }
+
+    if (src != &data) std::swap(data, scratch);
+}
+
+void RadixSort::sort(ParticleStore& particles, ThreadPool& pool, int threadCount, float adaptiveThreshold) {
+    const size_t n = particles.size();
+    lastSortMerged = false;
+    unsortedFraction = 0.0f;
+    if (n < 2) return;
+
+    keys.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = {particles.key[i], (uint32_t)i};
+    }
+
+    if (adaptiveThreshold >= 0.0f) {
+        size_t outOfOrder = countDescents(keys, pool, threadCount);
+        unsortedFraction = (float)outOfOrder / (float)(n - 1);
+
+        if (outOfOrder == 0) return;    // already in Morton order, nothing to permute
+
+        if (unsortedFraction <= adaptiveThreshold) {
+            mergeNearlySorted(keys, pool, threadCount);
+            lastSortMerged = true;
+        } else {
+            sortKeys(keys, pool, threadCount);
+        }
+    } else {
+        sortKeys(keys, pool, threadCount);
+    }
+
+    // apply the permutation once
+    particleScratch.gather(particles, keys, pool, threadCount);
+    particles.swap(particleScratch);
+}
@@ -44,33 +44,21 @@ void Renderer::init() {
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
 
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER,
-        particles->size() * sizeof(Particle),
-        particles->data(),
-        GL_DYNAMIC_DRAW);
-
-
-    glVertexAttribPointer(
-        0,                              // index
-        3,                              // size
-        GL_FLOAT,                       // type
-        GL_FALSE,                       // normalized
-        sizeof(Particle),               // stride
-        (void*)offsetof(Particle, x)    // offset
-    );
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(
-    1,                                  // index
-    3,                                  // size
-    GL_FLOAT,                           // type
-    GL_FALSE,                           // normalized
-    sizeof(Particle),                   // stride
-    (void*)offsetof(Particle, vx)       // offset
-    );
-    glEnableVertexAttribArray(1);
+    // positions live in three separate arrays, each one feeds a float attribute
+    glGenBuffers(3, VBO);
+    for (int axis = 0; axis < 3; axis++) {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO[axis]);
+        glVertexAttribPointer(
+            axis,                       // index
+            1,                          // size
+            GL_FLOAT,                   // type
+            GL_FALSE,                   // normalized
+            sizeof(float),              // stride
+            (void*)0                    // offset
+        );
+        glEnableVertexAttribArray(axis);
+    }
+    uploadPositions();
 
     shader = Shader("Particle.vex", "Particle.frag");
     shader.use();
@@ -143,17 +131,27 @@ void Renderer::initFrame() {
     ImGui::NewFrame();
 }
 
+void Renderer::uploadPositions() {
+    const float* axes[3] = {particles->x.data(), particles->y.data(), particles->z.data()};
+    size_t bytes = particles->size() * sizeof(float);
+
+    for (int axis = 0; axis < 3; axis++) {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO[axis]);
+
+        if (particles->size() != lastParticleCount) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, axes[axis], GL_DYNAMIC_DRAW);
+        } else {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, axes[axis]);
+        }
+    }
+    lastParticleCount = particles->size();
+}
+
 void Renderer::renderFrame() {
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBindVertexArray(VAO);
     shader.use();
 
-    if (particles->size() != lastParticleCount) {
-        glBufferData(GL_ARRAY_BUFFER, particles->size() * sizeof(Particle), particles->data(), GL_DYNAMIC_DRAW);
-        lastParticleCount = particles->size();
-    } else {
-        glBufferSubData(GL_ARRAY_BUFFER, 0, particles->size() * sizeof(Particle), particles->data());
-    }
+    uploadPositions();
 
     glm::mat4 modelMatrix(1.0f);
     glm::mat4 viewMatrix = camera.getViewMatrix();
@@ -167,11 +165,6 @@ void Renderer::renderFrame() {
     glUniformMatrix4fv(view,1,GL_FALSE,glm::value_ptr(viewMatrix));
     glUniformMatrix4fv(projection,1,GL_FALSE,glm::value_ptr(projectionMatrix));
 
-    glBufferSubData(GL_ARRAY_BUFFER,
-                     0,
-                     particles->size() * sizeof(Particle),
-                     particles->data());
-
     glDrawArrays(GL_POINTS, 0, particles->size());
 
     ImGui::Render();
@@ -202,9 +195,29 @@ void Renderer::prepareImGuiFrame() {
     }
 
     if (ImGui::SliderFloat("Theta", &THETA, 0.0f, 5.0f)) THETA_SQ = THETA * THETA;
+    ImGui::Checkbox("Ciasne prostopadlosciany (Salmon-Warren)", &TIGHT_BOUNDS);
     if (ImGui::SliderFloat("Epsilon", &EPSILON, 0.01f, 5.0f)) EPSILON_SQ = EPSILON * EPSILON;
     ImGui::InputFloat("Krok czasowy", &TIME_STEP, 10.0f, 1000.0f, "%.1f");
     ImGui::SliderInt("Watki", &NUM_THREADS, 1, MAX_HARDWARE_THREADS);
+    ImGui::Combo("Sily", &FORCE_MODE, "Osobno dla kazdego ciala\0Grupami (liscie)\0Drzewo podwojne (FMM)\0Bezposrednio (N^2)\0");
+    ImGui::InputInt("Bezposrednio ponizej N", &DIRECT_CROSSOVER, 256, 4096);
+    if (FORCE_MODE == FORCE_DUAL_TREE) ImGui::Checkbox("Oddzialywania wzajemne", &MUTUAL_INTERACTIONS);
+    ImGui::Checkbox("Adaptacyjne sortowanie", &ADAPTIVE_SORT);
+    ImGui::Checkbox("Przejscie bez rekurencji", &STACKLESS_WALK);
+    ImGui::Checkbox("Refit drzewa", &TREE_REFIT);
+    if (TREE_REFIT) {
+        ImGui::SliderInt("Przebudowa co", &REFIT_REBUILD_INTERVAL, 1, 100);
+        ImGui::SliderFloat("Maks. rozrost lisci", &REFIT_MAX_GROWTH, 1.0f, 3.0f);
+    }
+    ImGui::Combo("Calkowanie", &INTEGRATOR, "Leapfrog (2. rzad)\0Forest-Ruth / Yoshida (4. rzad)\0");
+    ImGui::Checkbox("Blokowe kroki czasowe", &BLOCK_TIMESTEPS);
+    if (BLOCK_TIMESTEPS) ImGui::SliderInt("Maks. poziom kroku", &MAX_STEP_LEVEL, 0, 10);
+    ImGui::Checkbox("Adaptacyjny krok czasowy", &ADAPTIVE_TIMESTEP);
+    if (ADAPTIVE_TIMESTEP && !BLOCK_TIMESTEPS) ImGui::InputFloat("Maks. krok", &MAX_TIME_STEP, 10.0f, 1000.0f, "%.1f");
+    if (BLOCK_TIMESTEPS || ADAPTIVE_TIMESTEP) ImGui::SliderFloat("Dokladnosc kroku (eta)", &TIMESTEP_ACCURACY, 0.005f, 0.2f);
+    ImGui::Checkbox("SIMD w lisciach", &SIMD_LEAF_KERNEL);
+    ImGui::SameLine();
+    ImGui::TextDisabled("(%s)", octree->leafKernelName());
     ImGui::Separator();
 
     // ##### CONFIG #####
@@ -212,6 +225,12 @@ void Renderer::prepareImGuiFrame() {
     ImGui::Text("TPS: %.1f", ImGui::GetIO().Framerate);
     ImGui::Text("Liczba cial: %zu", particles->size());
     ImGui::Text("Wierzcholki: %d", octree->nodeCount);
+    ImGui::Text("Budowa drzewa: %.2f ms, alokacje: %lld", BUILD_TIME_MS, (long long)BUILD_ALLOCATIONS);
+    ImGui::Text("Alokacje w kroku: %lld", (long long)STEP_ALLOCATIONS);
+    ImGui::Text("Nieposortowane klucze: %.3f%%", UNSORTED_KEY_FRACTION * 100.0f);
+    if (TREE_REFIT) ImGui::Text("Rozrost lisci: %.3f", REFIT_GROWTH);
+    if (BLOCK_TIMESTEPS) ImGui::Text("Aktywne ciala na podkrok: %.2f%%", ACTIVE_FRACTION * 100.0f);
+    ImGui::Text("Czas symulacji: %.4g", SIMULATED_TIME);
     ImGui::Text("Interakcje COM: %d", COM_INTERACTIONS);
     ImGui::Text("Bezposrednie interakcje: %d", DIRECT_INTERACTIONS);
     ImGui::Checkbox("Licz interakcje", &countInteractions);
@@ -0,0 +1,575 @@
+#include "Simulation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "AllocationCounter.h"
+#include "Globals.h"
+#include "Integrator.h"
+#include "ParticleGenerator.h"
+
+const char* const Simulation::STAGE_NAMES[STAGE_COUNT] =
+{
+    "1. render",
+    "2. kick + drift + bounds",
+    "3. morton codes",
+    "4. sort morton",
+    "5. build / refit tree",
+    "6. mass distribution",
+    "7. compute forces",
+    "8. closing kick"
+};
+
+void Simulation::step() {
+    const int64_t stepAllocations = heapAllocationCount();
+
+    if (BLOCK_TIMESTEPS && !particles.empty()) {
+        blockStep();
+        STEP_ALLOCATIONS = heapAllocationCount() - stepAllocations;
+        return;
+    }
+    ACTIVE_FRACTION = 1.0f;
+
+    // one kick + drift, tree and force pass per stage of the scheme, leapfrog has a single stage
+    const Integrator& integrator = selectIntegrator(INTEGRATOR);
+    const bool direct = usesDirectSummation();
+    for (int stage = 0; stage < integrator.stages; stage++) {
+        // 2. kick and drift, the box for a rebuild comes with it
+        auto t0 = std::chrono::high_resolution_clock::now();
+        kickDrift(integrator.kick[stage] * TIME_STEP, integrator.drift[stage] * TIME_STEP, NUM_THREADS);
+        accumulatedTimings[1] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+
+        if (!direct) updateTree();
+
+        // 7. compute forces (multithread), they overwrite the old accelerations
+        t0 = std::chrono::high_resolution_clock::now();
+        computeForces(std::max(1, NUM_THREADS));
+        accumulatedTimings[6] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    }
+
+    // 8. closing kick
+    auto t0 = std::chrono::high_resolution_clock::now();
+    kickAll(integrator.kick[integrator.stages] * TIME_STEP, NUM_THREADS);
+    accumulatedTimings[7] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    SIMULATED_TIME += TIME_STEP;
+    stepsSinceBuild++;      // once per step, whatever the number of force passes in it
+
+    // The step only changes between steps, so every kick and drift of one step uses the same dt. It is picked from
+    // the accelerations at the start of the step alone, which is not time-symmetric: over long runs the energy error
+    // can drift instead of staying bounded as with a fixed time_step.
+    if (ADAPTIVE_TIMESTEP && maxAccelerationSq > 0.0f) {
+        TIME_STEP = std::min(MAX_TIME_STEP, TIMESTEP_ACCURACY * sqrtf(EPSILON / sqrtf(maxAccelerationSq)));
+    }
+
+    STEP_ALLOCATIONS = heapAllocationCount() - stepAllocations;
+}
+
+// Block time-steps need the tree for their partial substeps, so they only sum directly in the full ones
+bool Simulation::usesDirectSummation() const {
+    if (BLOCK_TIMESTEPS) return false;
+    return FORCE_MODE == FORCE_DIRECT || (int64_t)particles.size() < DIRECT_CROSSOVER;
+}
+
+// Times the force pipelines themselves rather than step(): no time passes, no integrator or time step controller
+// runs, and the only globals touched are the force mode and the interaction counters, saved and put back here.
+int Simulation::measureDirectCrossover() {
+    const int forceMode = FORCE_MODE;
+    const int crossover = DIRECT_CROSSOVER;
+    const bool counting = countInteractions;
+    const int comInteractions = COM_INTERACTIONS;
+    const int directInteractions = DIRECT_INTERACTIONS;
+    FORCE_MODE = forceMode == FORCE_DIRECT ? FORCE_GROUP_WALK : forceMode;
+    DIRECT_CROSSOVER = -1;
+    countInteractions = false;
+
+    // the tree side pays for everything a step would build: bounds, codes, sort, build and mass pass
+    Simulation probe;
+    const int threads = std::max(1, NUM_THREADS);
+    auto directPass = [&] { probe.directSummation.computeForces(probe.particles, probe.threadPool, threads); };
+    auto treePass = [&] {
+        Bounds bounds = findMinMax(probe.particles, probe.threadPool, threads);
+        computeMortonCodes(probe.particles, bounds, probe.threadPool, threads);
+        probe.radixSort.sort(probe.particles, probe.threadPool, threads);
+        probe.octree.buildTree(probe.particles, probe.threadPool, threads);
+        probe.octree.computeMassDistribution(probe.particles, probe.threadPool, threads);
+        probe.computeForces(threads);
+    };
+
+    // best of 3 against scheduling noise
+    auto best = [](const auto& pass) {
+        double fastest = 1e30;
+        for (int r = 0; r < 3; r++) {
+            auto t0 = std::chrono::high_resolution_clock::now();
+            pass();
+            fastest = std::min(fastest, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count());
+        }
+        return fastest;
+    };
+
+    int result = MAX_DIRECT_CROSSOVER;
+    for (int n = 256; n < MAX_DIRECT_CROSSOVER; n *= 2) {
+        probe.particles = ParticleStore();
+        ParticleGenerator::createDisc(probe.particles, 0, 0, 0, n, genParticleMass, genCenterMass, minRadius, maxRadius, 0, 0, 0);
+        probe.particleCost.clear();
+
+        if (best(treePass) < best(directPass)) {
+            result = n;
+            break;
+        }
+    }
+
+    FORCE_MODE = forceMode;
+    DIRECT_CROSSOVER = crossover;
+    countInteractions = counting;
+    COM_INTERACTIONS = comInteractions;
+    DIRECT_INTERACTIONS = directInteractions;
+    return result;
+}
+
+// Both take the arrays as __restrict parameters: on locals inside the pool task GCC ignores it and the loops stay
+// scalar. Anchored bodies are scaled by 0 instead of skipped, so there is no branch either.
+static void kickDriftRange(float* __restrict x, float* __restrict y, float* __restrict z,
+                           float* __restrict vx, float* __restrict vy, float* __restrict vz,
+                           const float* __restrict ax, const float* __restrict ay, const float* __restrict az,
+                           const uint8_t* __restrict anchored, size_t start, size_t end, float kickStep, float driftStep) {
+    for (size_t i = start; i < end; i++) {
+        float free = anchored[i] ? 0.0f : 1.0f;
+        vx[i] += ax[i] * (kickStep * free);
+        vy[i] += ay[i] * (kickStep * free);
+        vz[i] += az[i] * (kickStep * free);
+        x[i] += vx[i] * (driftStep * free);
+        y[i] += vy[i] * (driftStep * free);
+        z[i] += vz[i] * (driftStep * free);
+    }
+}
+
+static void kickRange(float* __restrict vx, float* __restrict vy, float* __restrict vz,
+                      const float* __restrict ax, const float* __restrict ay, const float* __restrict az,
+                      const uint8_t* __restrict anchored, size_t start, size_t end, float kickStep) {
+    for (size_t i = start; i < end; i++) {
+        float free = anchored[i] ? 0.0f : 1.0f;
+        vx[i] += ax[i] * (kickStep * free);
+        vy[i] += ay[i] * (kickStep * free);
+        vz[i] += az[i] * (kickStep * free);
+    }
+}
+
+static void extendRange(const float* values, size_t start, size_t end, std::pair<float, float>& range) {
+    float lo = range.first, hi = range.second;
+    for (size_t i = start; i < end; i++) {
+        lo = std::min(lo, values[i]);
+        hi = std::max(hi, values[i]);
+    }
+    range = {lo, hi};
+}
+
+// One parallel pass for v += a * kickStep, x += v * driftStep and the box around the new positions,
+// instead of a sweep over the bodies for each of them.
+void Simulation::kickDrift(float kickStep, float driftStep, int threadCount) {
+    const size_t n = particles.size();
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+    threadCount = std::max(1, threadCount);
+    threadBounds.resize(threadCount);
+
+    ParticleStore& p = particles;
+    threadPool.run(threadCount, [&](int thread, int threads)
+    {
+        const size_t end = n * (thread + 1) / threads;
+        Bounds& box = threadBounds[thread];
+        box.fill({std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()});
+
+        // strip mined: the box of each block is taken while the block is still in L1, both loops vectorize
+        for (size_t block = n * thread / threads; block < end; block += KICK_DRIFT_BLOCK) {
+            const size_t blockEnd = std::min(block + KICK_DRIFT_BLOCK, end);
+            kickDriftRange(p.x.data(), p.y.data(), p.z.data(), p.vx.data(), p.vy.data(), p.vz.data(),
+                           p.ax.data(), p.ay.data(), p.az.data(), p.anchored.data(), block, blockEnd, kickStep, driftStep);
+
+            extendRange(p.x.data(), block, blockEnd, box[0]);
+            extendRange(p.y.data(), block, blockEnd, box[1]);
+            extendRange(p.z.data(), block, blockEnd, box[2]);
+        }
+    });
+
+    bodyBounds = threadBounds[0];
+    for (int t = 1; t < threadCount; t++) {
+        for (int axis = 0; axis < 3; axis++) {
+            bodyBounds[axis].first = std::min(bodyBounds[axis].first, threadBounds[t][axis].first);
+            bodyBounds[axis].second = std::max(bodyBounds[axis].second, threadBounds[t][axis].second);
+        }
+    }
+}
+
+void Simulation::kickAll(float kickStep, int threadCount) {
+    const size_t n = particles.size();
+    if (n < PARALLEL_MIN_BODIES) threadCount = 1;
+
+    ParticleStore& p = particles;
+    threadPool.run(std::max(1, threadCount), [&](int thread, int threads)
+    {
+        kickRange(p.vx.data(), p.vy.data(), p.vz.data(), p.ax.data(), p.ay.data(), p.az.data(), p.anchored.data(),
+                  n * thread / threads, n * (thread + 1) / threads, kickStep);
+    });
+}
+
+// morton codes (in the box of the last kickDrift), sort and a full build
+void Simulation::rebuildTree() {
+    // 3. recompute morton codes
+    auto t0 = std::chrono::high_resolution_clock::now();
+    computeMortonCodes(particles, bodyBounds, threadPool, NUM_THREADS);
+    accumulatedTimings[2] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+
+    // 4. sort by morton
+    t0 = std::chrono::high_resolution_clock::now();
+    radixSort.sort(particles, threadPool, NUM_THREADS, ADAPTIVE_SORT ? ADAPTIVE_SORT_THRESHOLD : -1.0f);
+    UNSORTED_KEY_FRACTION = radixSort.unsortedFraction;
+    accumulatedTimings[3] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+
+    // 5. rebuild tree
+    t0 = std::chrono::high_resolution_clock::now();
+    const int64_t buildAllocations = heapAllocationCount();
+    octree.buildTree(particles, threadPool, NUM_THREADS);
+    BUILD_ALLOCATIONS = heapAllocationCount() - buildAllocations;
+    BUILD_TIME_MS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    accumulatedTimings[4] += BUILD_TIME_MS;
+
+    stepsSinceBuild = 0;
+}
+
+// Refit the last tree while it stays tight enough, otherwise a full build. The mass pass refits the node sizes,
+// so the growth check follows it and an outgrown tree costs a second mass pass.
+void Simulation::updateTree() {
+    bool rebuild = octree.bodyCount() != particles.size() || !TREE_REFIT || stepsSinceBuild >= REFIT_REBUILD_INTERVAL;
+
+    // 6. mass distribution, with the bodies' boxes and the refitted sizes
+    auto massPass = [&] {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        octree.computeMassDistribution(particles, threadPool, NUM_THREADS);
+        accumulatedTimings[5] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    };
+
+    if (rebuild) rebuildTree();
+    else octree.refit();
+    massPass();
+
+    if (!rebuild) {
+        REFIT_GROWTH = octree.leafGrowth();
+        if (REFIT_GROWTH > REFIT_MAX_GROWTH) {
+            rebuildTree();
+            massPass();
+        }
+    }
+}
+
+// Block time-step substeps between the syncs: always the refit, whatever the rebuild interval, with the predicted
+// mass pass for the bodies drifted by dt, of which only those in kicked (null = all) changed velocity since the
+// last one. Only a tree outgrown past REFIT_MAX_GROWTH is rebuilt, which moves the bodies: returns whether it was.
+bool Simulation::updateSubstepTree(const std::vector<size_t>* kicked, float dt) {
+    // 6. mass distribution
+    auto massPass = [&](const std::vector<size_t>* kickedBodies) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        octree.predictMassDistribution(particles, kickedBodies, dt, threadPool, NUM_THREADS);
+        accumulatedTimings[5] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    };
+
+    if (octree.bodyCount() == particles.size()) {
+        octree.refit();
+        massPass(kicked);
+        REFIT_GROWTH = octree.leafGrowth();
+        if (REFIT_GROWTH <= REFIT_MAX_GROWTH) return false;
+    }
+
+    rebuildTree();
+    massPass(nullptr);
+    return true;
+}
+
+// finest level whose step keeps dt <= eta * sqrt(epsilon / |a|), at most maxLevel
+int Simulation::stepLevel(size_t index, int maxLevel) const {
+    float a = sqrtf(particles.ax[index] * particles.ax[index] + particles.ay[index] * particles.ay[index] + particles.az[index] * particles.az[index]);
+    float dt = TIMESTEP_ACCURACY * sqrtf(EPSILON / std::max(a, 1e-30f));
+    if (!(dt < TIME_STEP)) return 0;
+    return std::min(maxLevel, (int)std::ceil(std::log2(TIME_STEP / dt)));
+}
+
+static void kick(ParticleStore& particles, size_t index, float dt) {
+    if (particles.anchored[index]) return;
+    particles.vx[index] += particles.ax[index] * dt;
+    particles.vy[index] += particles.ay[index] * dt;
+    particles.vz[index] += particles.az[index] * dt;
+}
+
+// Hierarchical block time-steps: every body steps by TIME_STEP / 2^level, so the steps nest and all bodies meet
+// again after TIME_STEP. One call runs the 2^MAX_STEP_LEVEL substeps of the finest level. Every substep drifts
+// all bodies and predicts the tree, but only the bodies whose step ends there get new forces, their closing half
+// kick and the opening half kick of their next step (leapfrog KDK per body).
+void Simulation::blockStep() {
+    const int maxLevel = std::clamp(MAX_STEP_LEVEL, 0, 16);
+    const int substeps = 1 << maxLevel;
+    const float finest = TIME_STEP / substeps;
+    const size_t n = particles.size();
+    size_t activeTotal = 0;
+
+    // 2. opening half kicks, every body is in step here so any level is allowed
+    auto t0 = std::chrono::high_resolution_clock::now();
+    levelBodies.resize(maxLevel + 1);
+    for (std::vector<size_t>& bodies : levelBodies) bodies.clear();
+    for (size_t i = 0; i < n; i++) {
+        particles.level[i] = (uint8_t)stepLevel(i, maxLevel);
+        kick(particles, i, 0.5f * TIME_STEP / (float)(1 << particles.level[i]));
+        levelBodies[particles.level[i]].push_back(i);
+    }
+    accumulatedTimings[1] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+
+    for (int sub = 1; sub <= substeps; sub++) {
+        // 2. drift, positions of bodies between their kicks are predicted by the drift
+        t0 = std::chrono::high_resolution_clock::now();
+        kickDrift(0.0f, finest, NUM_THREADS);
+        accumulatedTimings[1] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+
+        // the bodies kicked since the last substep are still in activeBodies, all of them before the first one
+        const bool sync = sub == substeps;
+        if (sync) updateTree();
+        else if (updateSubstepTree(sub == 1 ? nullptr : &activeBodies, finest)) {
+            // the rebuild sorted the bodies, each of them still waits in the bucket of its level
+            for (std::vector<size_t>& bodies : levelBodies) bodies.clear();
+            for (size_t i = 0; i < n; i++) levelBodies[particles.level[i]].push_back(i);
+        }
+
+        // a level l step ends every 2^(maxLevel - l) substeps, so here the levels from coarsest up end theirs.
+        // Their slots come out of the buckets in Morton order for computeActiveForces, the sync takes every slot.
+        const int coarsest = maxLevel - std::countr_zero((unsigned)sub);
+        activeBodies.clear();
+        if (sync) {
+            activeBodies.resize(n);
+            for (size_t i = 0; i < n; i++) activeBodies[i] = i;
+        }
+        else {
+            for (int level = coarsest; level <= maxLevel; level++) {
+                activeBodies.insert(activeBodies.end(), levelBodies[level].begin(), levelBodies[level].end());
+                levelBodies[level].clear();
+            }
+            std::sort(activeBodies.begin(), activeBodies.end());
+        }
+        activeTotal += activeBodies.size();
+
+        t0 = std::chrono::high_resolution_clock::now();
+        if (activeBodies.size() == n) computeForces(std::max(1, NUM_THREADS));
+        else computeActiveForces(std::max(1, NUM_THREADS));
+        accumulatedTimings[6] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+
+        // 8. closing half kick, then a new level and its opening half kick unless the big step is over.
+        // The new step has to start on its own grid: no coarser than the lowest set bit of sub allows.
+        t0 = std::chrono::high_resolution_clock::now();
+        for (size_t i : activeBodies) {
+            kick(particles, i, 0.5f * TIME_STEP / (float)(1 << particles.level[i]));
+            if (sync) continue;
+
+            particles.level[i] = (uint8_t)std::max(coarsest, stepLevel(i, maxLevel));
+            kick(particles, i, 0.5f * TIME_STEP / (float)(1 << particles.level[i]));
+            levelBodies[particles.level[i]].push_back(i);
+        }
+        accumulatedTimings[7] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    }
+
+    ACTIVE_FRACTION = (float)((double)activeTotal / ((double)n * substeps));
+    SIMULATED_TIME += TIME_STEP;
+    stepsSinceBuild++;
+}
+
+static float accelerationSq(const ParticleStore& particles, size_t index) {
+    return particles.ax[index] * particles.ax[index] + particles.ay[index] * particles.ay[index] + particles.az[index] * particles.az[index];
+}
+
+// Also finds the largest |a|^2 for the time step controller: each thread keeps its own maximum over the bodies
+// it has just finished, while their accelerations are still in cache, so it costs no pass of its own.
+void Simulation::computeForces(int threadCount) {
+    particleCost.resize(particles.size());
+    threadMaxAccelerationSq.assign(threadCount, 0.0f);
+
+    if (usesDirectSummation() || FORCE_MODE == FORCE_DIRECT) {
+        directSummation.computeForces(particles, threadPool, threadCount);
+        maxAccelerationSq = directSummation.maxAccelerationSq;
+        return;
+    }
+
+    if (FORCE_MODE == FORCE_DUAL_TREE) {
+        dualTree.computeForces(octree, particles, threadPool, threadCount);
+        maxAccelerationSq = dualTree.maxAccelerationSq;
+        if (countInteractions) {
+            COM_INTERACTIONS = dualTree.cellInteractions;
+            DIRECT_INTERACTIONS = dualTree.directInteractions;
+        }
+        return;
+    }
+
+    if (FORCE_MODE == FORCE_GROUP_WALK) {
+        const std::vector<int>& leaves = octree.getLeaves();
+        if (interactionLists.size() < (size_t)threadCount) interactionLists.resize(threadCount);
+
+        std::atomic<size_t> nextLeaf = 0;
+        threadPool.run(threadCount, [&](int thread, int)
+        {
+            // leaves come in Morton order, so neighbouring chunks share most of their interaction lists
+            InteractionList& list = interactionLists[thread];
+            float maxSq = 0.0f;
+            size_t first;
+            while ((first = nextLeaf.fetch_add(LEAVES_PER_CHUNK)) < leaves.size())
+            {
+                size_t last = std::min(first + LEAVES_PER_CHUNK, leaves.size());
+                for (size_t l = first; l < last; l++)
+                {
+                    int cost = octree.computeForcesOnLeaf(leaves[l], particles, list);
+                    const Node& leaf = octree.getNode(leaves[l]);
+                    std::fill(particleCost.begin() + leaf.start, particleCost.begin() + leaf.end, (uint32_t)cost);
+                    for (int p = leaf.start; p < leaf.end; p++) maxSq = std::max(maxSq, accelerationSq(particles, p));
+                }
+            }
+            threadMaxAccelerationSq[thread] = maxSq;
+        });
+        maxAccelerationSq = *std::max_element(threadMaxAccelerationSq.begin(), threadMaxAccelerationSq.end());
+        return;
+    }
+
+    computeForceBlocks(threadCount);
+
+    std::atomic<size_t> nextBlock = 0;
+    threadPool.run(threadCount, [&](int thread, int)
+    {
+        // blocks are contiguous Morton ranges of similar cost, handed out first come first served
+        float maxSq = 0.0f;
+        size_t block;
+        while ((block = nextBlock.fetch_add(1)) + 1 < forceBlocks.size())
+        {
+            for (size_t i = forceBlocks[block]; i < forceBlocks[block + 1]; i++)
+            {
+                particleCost[i] = octree.computeForcesAffectingParticle(0, i, particles);
+                maxSq = std::max(maxSq, accelerationSq(particles, i));
+            }
+        }
+        threadMaxAccelerationSq[thread] = maxSq;
+    });
+    maxAccelerationSq = *std::max_element(threadMaxAccelerationSq.begin(), threadMaxAccelerationSq.end());
+}
+
+// Forces on the bodies in activeBodies only. The dual tree needs every body as a target, so partial substeps use the
+// group walk over the leaves holding an active body. Their other bodies get a fresh acceleration too, which is
+// harmless: a body's acceleration is only read at the ends of its own step, where it is recomputed first.
+void Simulation::computeActiveForces(int threadCount) {
+    particleCost.resize(particles.size());
+
+    if (FORCE_MODE == FORCE_PARTICLE_WALK) {
+        std::atomic<size_t> nextBody = 0;
+        threadPool.run(threadCount, [&](int, int)
+        {
+            size_t first;
+            while ((first = nextBody.fetch_add(ACTIVE_BODIES_PER_CHUNK)) < activeBodies.size())
+            {
+                size_t last = std::min(first + ACTIVE_BODIES_PER_CHUNK, activeBodies.size());
+                for (size_t k = first; k < last; k++)
+                {
+                    size_t i = activeBodies[k];
+                    particleCost[i] = octree.computeForcesAffectingParticle(0, i, particles);
+                }
+            }
+        });
+        return;
+    }
+
+    // both lists are in Morton order, so one pass pairs every active body with its leaf
+    const std::vector<int>& leaves = octree.getLeaves();
+    activeLeaves.clear();
+    size_t l = 0;
+    for (size_t i : activeBodies) {
+        while ((size_t)octree.getNode(leaves[l]).end <= i) l++;
+        if (activeLeaves.empty() || activeLeaves.back() != leaves[l]) activeLeaves.push_back(leaves[l]);
+    }
+
+    if (interactionLists.size() < (size_t)threadCount) interactionLists.resize(threadCount);
+
+    std::atomic<size_t> nextLeaf = 0;
+    threadPool.run(threadCount, [&](int thread, int)
+    {
+        InteractionList& list = interactionLists[thread];
+        size_t first;
+        while ((first = nextLeaf.fetch_add(LEAVES_PER_CHUNK)) < activeLeaves.size())
+        {
+            size_t last = std::min(first + LEAVES_PER_CHUNK, activeLeaves.size());
+            for (size_t k = first; k < last; k++)
+            {
+                int cost = octree.computeForcesOnLeaf(activeLeaves[k], particles, list);
+                const Node& leaf = octree.getNode(activeLeaves[k]);
+                std::fill(particleCost.begin() + leaf.start, particleCost.begin() + leaf.end, (uint32_t)cost);
+            }
+        }
+    });
+}
+
+void Simulation::computeForceBlocks(int threadCount) {
+    size_t n = particles.size();
+    size_t blockCount = std::min(n, (size_t)threadCount * FORCE_BLOCKS_PER_THREAD);
+
+    forceBlocks.clear();
+    forceBlocks.push_back(0);
+    if (blockCount == 0) return;
+
+    // no cost history yet (first step or bodies added/removed) - equal sized blocks
+    if (particleCost.size() != n) {
+        for (size_t b = 1; b <= blockCount; b++) {
+            forceBlocks.push_back(n * b / blockCount);
+        }
+        return;
+    }
+
+    // the Morton order barely changes between steps, so slot i costs about what it cost last step
+    uint64_t totalCost = 0;
+    for (uint32_t cost : particleCost) {
+        totalCost += cost + 1;
+    }
+
+    uint64_t accumulated = 0;
+    size_t block = 1;
+    for (size_t i = 0; i < n && block < blockCount; i++) {
+        accumulated += particleCost[i] + 1;
+        if (accumulated * blockCount >= totalCost * block) {
+            forceBlocks.push_back(i + 1);
+            block++;
+        }
+    }
+    forceBlocks.push_back(n);
+}
+
+void Simulation::printProfiling(std::ostream& out, int frameCount, bool includeRender) const {
+    if (frameCount <= 0) return;
+
+    double totalAvgTime = 0.0;
+    std::array<double, STAGE_COUNT> avgTimings = {0.0};
+
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        avgTimings[i] = accumulatedTimings[i] / frameCount;
+        if (i > 0) totalAvgTime += avgTimings[i];   // render is not part of the simulation step
+    }
+
+    out << "\n===== PROFILING FOR " << particles.size() << " BODIES (AVERAGE PER FRAME) =====\n";
+
+    for (int i = includeRender ? 0 : 1; i < STAGE_COUNT; ++i)
+    {
+        double percent = totalAvgTime > 0.0 ? (avgTimings[i] / totalAvgTime) * 100.0 : 0.0;
+
+        out
+            << STAGE_NAMES[i]
+            << ": "
+            << avgTimings[i]
+            << " ms ("
+            << percent
+            << "%)\n";
+    }
+    out << "TOTAL AVERAGE frame time: " << totalAvgTime << " ms\n";
+}
+
+void Simulation::resetTimings() {
+    accumulatedTimings.fill(0.0);
+}
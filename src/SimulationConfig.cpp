@@ -0,0 +1,166 @@
+#include "SimulationConfig.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "Globals.h"
+#include "ParticleGenerator.h"
+
+static std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t\r");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \t\r");
+    return s.substr(first, last - first + 1);
+}
+
+// scene entries: fixed arguments followed by an optional velocity (vx vy vz)
+static bool addScene(const std::string& key, const std::vector<float>& v, Simulation& simulation) {
+    auto& particles = simulation.particles;
+    auto vel = [&](size_t i) { return i < v.size() ? v[i] : 0.0f; };
+
+    if (key == "particle") {
+        if (v.size() != 4 && v.size() != 7) return false;
+        ParticleGenerator::addParticle(particles, v[0], v[1], v[2], v[3], vel(4), vel(5), vel(6));
+    }
+    else if (key == "rectangle" || key == "cube") {
+        if (v.size() != 5 && v.size() != 8) return false;
+        if (key == "rectangle") {
+            ParticleGenerator::createFlatRectangle(particles, v[0], v[1], v[2], (int)v[3], v[4], vel(5), vel(6), vel(7));
+        } else {
+            ParticleGenerator::createCube(particles, v[0], v[1], v[2], (int)v[3], v[4], vel(5), vel(6), vel(7));
+        }
+    }
+    else if (key == "disc" || key == "sphere") {
+        if (v.size() != 8 && v.size() != 11) return false;
+        if (key == "disc") {
+            ParticleGenerator::createDisc(particles, v[0], v[1], v[2], (int)v[3], v[4], v[5], v[6], v[7], vel(8), vel(9), vel(10));
+        } else {
+            ParticleGenerator::createSphere(particles, v[0], v[1], v[2], (int)v[3], v[4], v[5], v[6], v[7], vel(8), vel(9), vel(10));
+        }
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool SimulationConfig::load(const std::string& path, Simulation& simulation) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cout << "Failed to read config file: " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+
+    while (std::getline(file, line)) {
+        lineNumber++;
+
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        line = trim(line);
+        if (line.empty()) continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            std::cout << path << ":" << lineNumber << ": expected 'key = value'\n";
+            return false;
+        }
+
+        std::string key = trim(line.substr(0, eq));
+        std::istringstream values(line.substr(eq + 1));
+
+        bool ok = true;
+        if (key == "steps") ok = static_cast<bool>(values >> steps);
+        else if (key == "report_every") ok = static_cast<bool>(values >> reportEvery);
+        else if (key == "output") ok = static_cast<bool>(values >> outputPath);
+        else if (key == "step_log") ok = static_cast<bool>(values >> stepLogPath);
+        else if (key == "threads") {
+            ok = static_cast<bool>(values >> NUM_THREADS) && NUM_THREADS > 0;
+        }
+        else if (key == "leaf_size") ok = static_cast<bool>(values >> SPLIT_AT_LEAF_SIZE) && SPLIT_AT_LEAF_SIZE > 0;
+        else if (key == "theta") {
+            ok = static_cast<bool>(values >> THETA);
+            THETA_SQ = THETA * THETA;
+        }
+        else if (key == "epsilon") {
+            ok = static_cast<bool>(values >> EPSILON);
+            EPSILON_SQ = EPSILON * EPSILON;
+        }
+        else if (key == "time_step") ok = static_cast<bool>(values >> TIME_STEP);
+        else if (key == "g_multiplier") ok = static_cast<bool>(values >> G_MULTIPLIER);
+        else if (key == "spread_radius") ok = static_cast<bool>(values >> SPREAD_RADIUS);
+        else if (key == "anchor") ok = static_cast<bool>(values >> ANCHOR);
+        else if (key == "force_mode") {
+            std::string mode;
+            ok = static_cast<bool>(values >> mode);
+            if (mode == "particle") FORCE_MODE = FORCE_PARTICLE_WALK;
+            else if (mode == "group") FORCE_MODE = FORCE_GROUP_WALK;
+            else if (mode == "dual") FORCE_MODE = FORCE_DUAL_TREE;
+            else if (mode == "direct") FORCE_MODE = FORCE_DIRECT;
+            else ok = false;
+        }
+        else if (key == "integrator") {
+            std::string name;
+            ok = static_cast<bool>(values >> name);
+            if (name == "leapfrog") INTEGRATOR = INTEGRATOR_LEAPFROG;
+            else if (name == "yoshida4" || name == "forest_ruth") INTEGRATOR = INTEGRATOR_YOSHIDA4;
+            else ok = false;
+        }
+        else if (key == "direct_crossover") {
+            std::string value;
+            ok = static_cast<bool>(values >> value);
+            if (value == "auto") DIRECT_CROSSOVER = -1;
+            else ok = static_cast<bool>(std::istringstream(value) >> DIRECT_CROSSOVER) && DIRECT_CROSSOVER >= 0;
+        }
+        else if (key == "tight_bounds") ok = static_cast<bool>(values >> TIGHT_BOUNDS);
+        else if (key == "mutual_interactions") ok = static_cast<bool>(values >> MUTUAL_INTERACTIONS);
+        else if (key == "stackless_walk") ok = static_cast<bool>(values >> STACKLESS_WALK);
+        else if (key == "simd_leaf_kernel") ok = static_cast<bool>(values >> SIMD_LEAF_KERNEL);
+        else if (key == "adaptive_sort") ok = static_cast<bool>(values >> ADAPTIVE_SORT);
+        else if (key == "adaptive_sort_threshold") ok = static_cast<bool>(values >> ADAPTIVE_SORT_THRESHOLD);
+        else if (key == "tree_refit") ok = static_cast<bool>(values >> TREE_REFIT);
+        else if (key == "refit_interval") ok = static_cast<bool>(values >> REFIT_REBUILD_INTERVAL) && REFIT_REBUILD_INTERVAL > 0;
+        else if (key == "refit_max_growth") ok = static_cast<bool>(values >> REFIT_MAX_GROWTH);
+        else if (key == "block_timesteps") ok = static_cast<bool>(values >> BLOCK_TIMESTEPS);
+        else if (key == "max_step_level") ok = static_cast<bool>(values >> MAX_STEP_LEVEL) && MAX_STEP_LEVEL >= 0 && MAX_STEP_LEVEL <= 16;
+        else if (key == "timestep_accuracy") ok = static_cast<bool>(values >> TIMESTEP_ACCURACY) && TIMESTEP_ACCURACY > 0.0f;
+        else if (key == "adaptive_timestep") ok = static_cast<bool>(values >> ADAPTIVE_TIMESTEP);
+        else if (key == "max_time_step") ok = static_cast<bool>(values >> MAX_TIME_STEP) && MAX_TIME_STEP > 0.0f;
+        else if (key == "count_interactions") ok = static_cast<bool>(values >> countInteractions);
+        else {
+            std::vector<float> args;
+            float f;
+            while (values >> f) args.push_back(f);
+            ok = values.eof() && addScene(key, args, simulation);
+        }
+
+        if (!ok) {
+            std::cout << path << ":" << lineNumber << ": invalid entry '" << key << "'\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SimulationConfig::writeSnapshot(const Simulation& simulation) const {
+    if (outputPath.empty()) return true;
+
+    std::ofstream out(outputPath);
+    if (!out.is_open()) {
+        std::cout << "Failed to write snapshot: " << outputPath << "\n";
+        return false;
+    }
+
+    out << "x,y,z,vx,vy,vz,mass\n";
+    const ParticleStore& p = simulation.particles;
+    for (size_t i = 0; i < p.size(); i++) {
+        out << p.x[i] << ',' << p.y[i] << ',' << p.z[i] << ','
+            << p.vx[i] << ',' << p.vy[i] << ',' << p.vz[i] << ','
+            << p.mass[i] << '\n';
+    }
+    return true;
+}
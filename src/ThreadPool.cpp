@@ -0,0 +1,72 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadCount) {
+    grow(threadCount);
+}
+
+ThreadPool::~ThreadPool() {
+    stopping = true;
+    generation.fetch_add(1 << 16);
+    generation.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::grow(int threadCount) {
+    // worker 0 is the calling thread
+    for (int i = (int)workers.size() + 1; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+void ThreadPool::workerLoop(int index) {
+    uint64_t seen = 0;
+
+    while (true) {
+        generation.wait(seen);
+        seen = generation.load();
+
+        if (stopping) return;
+
+        // the count travels in the same word as the epoch, so a worker never mixes two runs
+        int activeCount = (int)(seen & 0xFFFF);
+        if (index >= activeCount) continue;
+
+        task.invoke(task.callable, index, activeCount);
+
+        if (pending.fetch_sub(1) == 1) {
+            pending.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runTask(int threadCount, TaskRef job) {
+    threadCount = std::clamp(threadCount, 1, 0xFFFF);
+    if (threadCount == 1) {
+        job.invoke(job.callable, 0, 1);
+        return;
+    }
+    grow(threadCount);
+
+    task = job;
+    pending = threadCount - 1;
+
+    uint64_t epoch = (generation.load() >> 16) + 1;
+    generation.store((epoch << 16) | (uint64_t)threadCount);
+    generation.notify_all();
+
+    job.invoke(job.callable, 0, threadCount);
+
+    // short spin first, most workers finish close to the caller
+    for (int spin = 0; spin < 4096 && pending.load() != 0; spin++) {
+        std::this_thread::yield();
+    }
+    int left;
+    while ((left = pending.load()) != 0) {
+        pending.wait(left);
+    }
+}